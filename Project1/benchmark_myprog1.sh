@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Compare the run time of myprog1.sh with the one of its compiled version, myprog1.c,
+# on a file of random digits. The number of lines can be given, 100000 by default.
+if [ $# -gt 1 ]; then
+	echo "Usage: $0 [number of lines]"
+	exit 1
+fi
+lines="${1:-100000}"
+directory="$(dirname "$0")"
+
+# Build the compiled version if it is not built yet
+if [ ! -x "$directory/myprog1" ]; then
+	gcc -Wall -Wextra -O2 -pthread -o "$directory/myprog1" "$directory/myprog1.c" || exit 1
+fi
+
+# Create the input file and the output files
+input=$(mktemp)
+scriptOutput=$(mktemp)
+nativeOutput=$(mktemp)
+trap 'rm -f "$input" "$scriptOutput" "$nativeOutput"' EXIT
+awk -v lines="$lines" 'BEGIN { srand(1); for (i = 0; i < lines; i++) print int(rand() * 10) }' >"$input"
+
+# Run both versions, timing each one
+TIMEFORMAT="%R"
+echo "Lines: $lines"
+scriptTime=$( { time MYPROG1_NATIVE=0 bash "$directory/myprog1.sh" "$input" >"$scriptOutput"; } 2>&1)
+echo "myprog1.sh: $scriptTime s"
+nativeTime=$( { time "$directory/myprog1" "$input" >"$nativeOutput"; } 2>&1)
+echo "myprog1:    $nativeTime s"
+
+# Check that both versions printed the same output
+if cmp -s "$scriptOutput" "$nativeOutput"; then
+	echo "Outputs are the same"
+	awk -v script="$scriptTime" -v native="$nativeTime" \
+		'BEGIN { if (native > 0) printf "Speedup: %.0fx\n", script / native }'
+else
+	echo "Outputs are different!"
+	exit 1
+fi
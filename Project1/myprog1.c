@@ -0,0 +1,336 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * This program is the compiled version of myprog1.sh, which myprog1.sh runs when it is built next to it:
+ *
+ *     gcc -Wall -Wextra -O2 -pthread -o myprog1 myprog1.c
+ *
+ * Like the script, it reads a file with one digit on every line, and prints a row of stars for every digit, with as many
+ * stars as the number of lines with that digit. It prints the same messages, on the standard output, and exits with 1
+ * if no file is given, if the file is not found, or if a line is not a single digit. As with the "while read" loop of
+ * the script, a last line that does not end with a newline is not read.
+ *
+ * A valid file is a sequence of two-byte lines, a digit and a newline, so the lines are counted two bytes at a time:
+ *     - The file is mapped into memory and split into slices of an even number of bytes, one per thread.
+ *     - Every thread checks and counts the lines of its slice into counters of its own, with the AVX2 kernel on the
+ *       processors that support it and with the table kernel otherwise. The counters are added once the threads end.
+ *     - Every row of stars is printed with a single write, from one buffer of stars.
+ *
+ * The program defines the following functions:
+ *     - initPairTable: This function is used to fill the table of the table kernel.
+ *     - countLinesTable: This function is the table kernel, which checks and counts the lines of a slice.
+ *     - countLinesAvx2: This function is the AVX2 kernel, which checks and counts 16 lines at a time.
+ *     - selectKernel: This function is used to choose the fastest kernel the processor supports.
+ *     - countWorker: This function is run by the threads that count the lines of the slices.
+ *     - writeAll: This function is used to write a buffer, even if the write is partial.
+ *     - main: This function is used to check the input file, count its lines and print the rows of stars.
+ */
+
+#define CACHE_LINE_SIZE 64
+#define MIN_SLICE_SIZE (1 << 20)    /* smallest slice of the file given to a thread */
+#define MAX_THREADS 64
+
+typedef int (*LineCounter)(const unsigned char *data, size_t length, uint64_t counts[10]);
+
+typedef struct {
+    const unsigned char *data;
+    size_t length;              /* even, so that the slice starts and ends on a line */
+    uint64_t counts[10];
+    int valid;
+} __attribute__((aligned(CACHE_LINE_SIZE))) CountTask;
+
+int8_t pairDigit[65536];        /* digit of every two-byte line, read as a uint16_t, or -1 if the line is not valid */
+LineCounter countLines = NULL;  /* kernel of the threads, chosen by selectKernel */
+
+void initPairTable();
+
+int countLinesTable(const unsigned char *data, size_t length, uint64_t counts[10]);
+
+int countLinesAvx2(const unsigned char *data, size_t length, uint64_t counts[10]);
+
+void selectKernel();
+
+void *countWorker(void *args);
+
+int writeAll(const char *buffer, size_t length);
+
+/**
+ * This function is used to fill the table of the table kernel.
+ *
+ * Every entry of pairDigit is -1, except the ten entries of a digit followed by a newline, in the byte order of the
+ * processor, which hold the digit.
+ */
+void initPairTable() {
+    memset(pairDigit, -1, sizeof(pairDigit));
+    for (int digit = 0; digit < 10; digit++) {
+        unsigned char line[2] = {(unsigned char) ('0' + digit), '\n'};
+        uint16_t pair;
+        memcpy(&pair, line, sizeof(pair));
+        pairDigit[pair] = (int8_t) digit;
+    }
+}
+
+/**
+ * This function is the table kernel, which checks and counts the lines of a slice.
+ *
+ * @param data The slice, which starts on a line.
+ * @param length The length of the slice, which is even.
+ * @param counts The number of lines of every digit is added here.
+ * @return Returns 1 if every line of the slice is valid, 0 otherwise.
+ *
+ * Every line is looked up in pairDigit. The lines are counted into four sets of counters in turn, so that runs of the
+ * same digit do not wait on each other's increments, and the sets are added at the end.
+ */
+int countLinesTable(const unsigned char *data, size_t length, uint64_t counts[10]) {
+    uint64_t partial[4][10] = {{0}};
+    size_t lines = length / 2, i = 0;
+    for (; i + 4 <= lines; i += 4) {
+        uint16_t pairs[4];
+        memcpy(pairs, data + 2 * i, sizeof(pairs));
+        int8_t first = pairDigit[pairs[0]], second = pairDigit[pairs[1]];
+        int8_t third = pairDigit[pairs[2]], fourth = pairDigit[pairs[3]];
+        if ((first | second | third | fourth) < 0)
+            return 0;
+        partial[0][first]++;
+        partial[1][second]++;
+        partial[2][third]++;
+        partial[3][fourth]++;
+    }
+    for (; i < lines; i++) {
+        uint16_t pair;
+        memcpy(&pair, data + 2 * i, sizeof(pair));
+        if (pairDigit[pair] < 0)
+            return 0;
+        partial[0][pairDigit[pair]]++;
+    }
+    for (int digit = 0; digit < 10; digit++) {
+        counts[digit] += partial[0][digit] + partial[1][digit] + partial[2][digit] + partial[3][digit];
+    }
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * This function is the AVX2 kernel, which checks and counts 16 lines at a time.
+ *
+ * Every block of 32 bytes is XORed with 16 lines of "0\n", which turns the digits into 0 to 9 and the newlines into 0,
+ * so the block is valid if no byte is larger than the one of 16 lines of 9 and 0. The newlines are then set to 0x80, and
+ * the digits 1 to 9 are counted with a comparison each into byte counters, which are added into 64-bit counters with
+ * _mm256_sad_epu8 before they can overflow. The lines of 0 are the ones left. The last bytes are counted by the table
+ * kernel.
+ */
+__attribute__((target("avx2")))
+int countLinesAvx2(const unsigned char *data, size_t length, uint64_t counts[10]) {
+    const __m256i zeros = _mm256_set1_epi16('0' | '\n' << 8);
+    const __m256i limit = _mm256_set1_epi16(9);
+    const __m256i newlines = _mm256_set1_epi16((short) 0x8000);
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t found = 0;
+    size_t i = 0;
+    while (i + 32 <= length) {
+        __m256i byteCounts[9], invalid = zero;
+        for (int digit = 0; digit < 9; digit++) {
+            byteCounts[digit] = zero;
+        }
+        // a byte counter gets at most one per block, so it can count 255 blocks
+        for (int block = 0; block < 255 && i + 32 <= length; block++, i += 32) {
+            __m256i lines = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (data + i)), zeros);
+            invalid = _mm256_or_si256(invalid, _mm256_xor_si256(_mm256_max_epu8(lines, limit), limit));
+            lines = _mm256_or_si256(lines, newlines);
+            for (int digit = 0; digit < 9; digit++) {
+                __m256i equal = _mm256_cmpeq_epi8(lines, _mm256_set1_epi8((char) (digit + 1)));
+                byteCounts[digit] = _mm256_sub_epi8(byteCounts[digit], equal);
+            }
+        }
+        if (!_mm256_testz_si256(invalid, invalid))
+            return 0;
+        for (int digit = 0; digit < 9; digit++) {
+            uint64_t sums[4];
+            _mm256_storeu_si256((__m256i *) sums, _mm256_sad_epu8(byteCounts[digit], zero));
+            uint64_t count = sums[0] + sums[1] + sums[2] + sums[3];
+            counts[digit + 1] += count;
+            found += count;
+        }
+    }
+    counts[0] += i / 2 - found;
+    return countLinesTable(data + i, length - i, counts);
+}
+
+#endif
+
+/**
+ * This function is used to choose the kernel of the threads for the processor the program runs on.
+ *
+ * The AVX2 kernel is used if the processor supports it, and the table kernel otherwise. The choice can be forced with the
+ * MYPROG1_KERNEL environment variable (table or avx2), for example to compare the kernels.
+ */
+void selectKernel() {
+    const char *kernel = getenv("MYPROG1_KERNEL");
+    countLines = countLinesTable;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && (kernel == NULL || !strcmp(kernel, "avx2")))
+        countLines = countLinesAvx2;
+#else
+    (void) kernel;
+#endif
+}
+
+/**
+ * This function is run by the threads that count the lines of the slices.
+ *
+ * @param args The CountTask of the thread, which gets the counters and the validity of its slice.
+ */
+void *countWorker(void *args) {
+    CountTask *task = (CountTask *) args;
+    task->valid = countLines(task->data, task->length, task->counts);
+    return NULL;
+}
+
+/**
+ * This function is used to write a buffer to the standard output.
+ *
+ * @param buffer The buffer.
+ * @param length The length of the buffer.
+ * @return Returns 0 on success, -1 on error.
+ *
+ * The write is repeated for the rest of the buffer if it is partial, or interrupted by a signal.
+ */
+int writeAll(const char *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, buffer, length);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buffer += written;
+        length -= (size_t) written;
+    }
+    return 0;
+}
+
+/**
+ * This function is used to check the input file, count its lines and print the rows of stars.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments. The input file is expected to be in argv[1].
+ * @return Returns 0 on success, 1 if the arguments or the file are not valid.
+ *
+ * The file is mapped into memory, and the part that is read, up to the last newline, is split into one slice per thread,
+ * with at least MIN_SLICE_SIZE bytes per slice. The part must have an even length, since every line is two bytes.
+ * Every row is the digit, a space, the stars and a newline, built in one buffer that holds the stars of the largest row:
+ * the newline is put after the stars of the row, the row is written, and the star it replaced is put back.
+ */
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        printf("Please give an input file!\n");
+        return 1;
+    }
+    const char *fileName = argv[1];
+    struct stat st;
+    if (stat(fileName, &st) == -1 || !S_ISREG(st.st_mode)) {
+        printf("File not found: %s\n", fileName);
+        return 1;
+    }
+    int fd = open(fileName, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(fileName);
+        return 1;
+    }
+
+    uint64_t counts[10] = {0};
+    size_t size = (size_t) st.st_size;
+    if (size > 0) {
+        const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        madvise((void *) data, size, MADV_SEQUENTIAL);
+        selectKernel();
+        initPairTable();
+
+        // the last line is not read if it does not end with a newline
+        const unsigned char *lastNewline = memrchr(data, '\n', size);
+        size_t length = lastNewline == NULL ? 0 : (size_t) (lastNewline - data) + 1;
+        if (length % 2 != 0) {
+            printf("Input file is not valid!\n");
+            return 1;
+        }
+
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        int numberOfThreads = processors < 1 ? 1 : processors > MAX_THREADS ? MAX_THREADS : (int) processors;
+        if ((size_t) numberOfThreads > length / MIN_SLICE_SIZE)
+            numberOfThreads = length / MIN_SLICE_SIZE > 0 ? (int) (length / MIN_SLICE_SIZE) : 1;
+        CountTask *tasks = aligned_alloc(CACHE_LINE_SIZE, numberOfThreads * sizeof(CountTask));
+        pthread_t threads[MAX_THREADS];
+        if (tasks == NULL) {
+            perror("aligned_alloc");
+            return 1;
+        }
+        size_t sliceSize = length / numberOfThreads & ~(size_t) 1;
+        for (int i = 0; i < numberOfThreads; i++) {
+            memset(&tasks[i], 0, sizeof(CountTask));
+            tasks[i].data = data + i * sliceSize;
+            tasks[i].length = i == numberOfThreads - 1 ? length - i * sliceSize : sliceSize;
+            if (i > 0 && pthread_create(&threads[i], NULL, countWorker, &tasks[i]) != 0) {
+                perror("pthread_create");
+                return 1;
+            }
+        }
+        countWorker(&tasks[0]);
+        for (int i = 0; i < numberOfThreads; i++) {
+            if (i > 0)
+                pthread_join(threads[i], NULL);
+            if (!tasks[i].valid) {
+                printf("Input file is not valid!\n");
+                return 1;
+            }
+            for (int digit = 0; digit < 10; digit++) {
+                counts[digit] += tasks[i].counts[digit];
+            }
+        }
+        free(tasks);
+        munmap((void *) data, size);
+    }
+    close(fd);
+
+    uint64_t largest = 0;
+    for (int digit = 0; digit < 10; digit++) {
+        if (counts[digit] > largest)
+            largest = counts[digit];
+    }
+    char *row = malloc(largest + 3);
+    if (row == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    memset(row + 2, '*', largest + 1);
+    row[1] = ' ';
+    for (int digit = 0; digit < 10; digit++) {
+        row[0] = (char) ('0' + digit);
+        row[counts[digit] + 2] = '\n';
+        if (writeAll(row, counts[digit] + 3) == -1) {
+            perror("write");
+            return 1;
+        }
+        row[counts[digit] + 2] = '*';
+    }
+    free(row);
+    return 0;
+}
@@ -1,5 +1,12 @@
 #!/bin/bash
 
+# Run the compiled version, myprog1.c, if it was built next to this script.
+# MYPROG1_NATIVE=0 runs this script instead, for example to compare the two.
+native="$(dirname "$0")/myprog1"
+if [ "${MYPROG1_NATIVE:-1}" != 0 ] && [ -x "$native" ]; then
+	exec "$native" "$@"
+fi
+
 # Check if an argument is given
 if [ $# -ne 1 ]; then
 	echo "Please give an input file!"
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,13 +7,42 @@
 #include <string.h>
 #include <signal.h>
 #include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <stdint.h>
+#include <fnmatch.h>
+#include <ftw.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <ctype.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 /**
  * This program is a simple shell that supports the following features:
  *     - Running executables in the current directory or in the PATH environment variable.
  *     - Input/output redirection.
- *     - Searching for a string in the current directory or in a file.
- *     - Bookmarks.
+ *     - Searching for a string in the current directory or in a file, optionally with a trigram index.
+ *     - Bookmarks, kept in a bookmark file and run without sh unless they use shell syntax.
+ *     - Running a set of bookmarks in parallel, with a limit on how many run at the same time.
+ *     - Caching the paths of executables found in PATH.
+ *     - Starting processes with posix_spawn, or with fork and execv as a fallback.
+ *     - Pipelines of any number of commands connected with "|".
+ *     - A job table of the background jobs, with the jobs, fg and bg builtins.
+ *     - One event loop, built on epoll, a signalfd and pidfds, that waits for the input, the signals and the children.
+ *     - Accounting of the time and resources used by every command, shown by the time builtin and written to a log file.
+ *     - Running the commands of a script file, or of the -c option, without prompting.
+ *     - The cd, echo, pwd, test, true and false builtins, which run in the shell process even when their output is redirected.
  *
  * The program first defines some global variables:
  *     - input, output, append, standardError: These variables are used to check if input/output redirection is to be performed.
@@ -20,29 +50,130 @@
  *     - inputFile, outputFile: These variables are used to store the input and output file names for input/output redirection.
  *     - executablePath: This variable is used to store the path to the executable file.
  *     - path: This variable is used to store the path to the executable file.
- *     - foregroundProcess: This variable is used to store the pid of the foreground process.
- *     - backgroundProcesses: This variable is used to store the pids of the background processes.
- *     - backgroundProcessCount: This variable is used to store the number of background processes.
+ *     - jobs, jobProcesses: These variables are the slabs of the job table, which hold the jobs and their processes.
+ *     - jobProcessIndex: This variable is a hash table that maps the pid of a process to its entry in jobProcesses.
+ *     - freeJob, freeJobProcess, freeJobProcessCount: These variables are used to store the free lists of the job table.
+ *     - jobCount: This variable is used to store the number of jobs.
+ *     - notifyCount: This variable is used to store the number of jobs whose change of state has not been printed yet.
+ *     - foregroundJob: This variable is used to store the job the shell waits for, or -1.
+ *     - eventFd, signalFd: These variables are used to store the epoll instance of the main loop and the signalfd it watches.
+ *     - inputWatchable, inputWatched: These variables are used to record if the standard input can be and is watched by epoll.
+ *     - pidfdSupported: This variable is used to record if the children can be reaped through pidfds.
+ *     - originalSignalMask: This variable is used to store the signal mask the shell started with, which the children get back.
+ *     - timeCommand: This variable is used to record that the command line starts with the time builtin.
+ *     - inputReader: This variable is used to read the command lines from the standard input, a script or the -c option.
+ *     - interactive: This variable is used to record if the shell prompts for the commands.
+ *     - lastStatus: This variable is used to store the status of the last foreground job or builtin, which a script exits with.
+ *     - builtins, builtinTable: These variables are used to store the builtin commands and their perfect hash table.
+ *     - accountingLog: This variable is used to store the file the resource use of every job is written to, or -1.
+ *     - commandLine: This variable is used to store the command line being run, as it is shown by the jobs builtin.
  *     - bookmarks: This variable is used to store the bookmarks.
- *     - bookmarkCount: This variable is used to store the number of bookmarks.
+ *     - bookmarkCount, bookmarkCapacity: These variables are used to store the number of bookmarks and the size of the array.
+ *     - bookmarkPath: This variable is used to store the path of the bookmark file.
+ *     - bookmarkText, bookmarkTextSize: These variables are used to store the copy of the bookmark file the bookmarks point into.
+ *     - bookmarksLoaded: This variable is used to record if the bookmark file was read.
+ *     - runningBookmarks: This variable is used to store the number of bookmarks that are running.
+ *     - pathCache: This variable is a hash table that maps command names to their absolute paths.
+ *     - pathDirectories, pathDirectoryCount: These variables are used to store the directories of PATH and their modification times.
+ *     - cachedPathValue: This variable is used to store the value of PATH the cache was filled with.
+ *     - pathCacheHits, pathCacheMisses: These variables are used to count the lookups answered by the cache and the ones that were not.
+ *     - spawnBackend: This variable is used to select how processes are started (SPAWN_POSIX or SPAWN_FORK).
+ *     - findSubstring: This variable is used to store the substring kernel used by the search.
  *
  * Then it defines the following functions:
  *     - setup: This function is used to read the command line and separate it into distinct arguments.
+ *     - readLine: This function is used to read the next line of the input through a growable buffer.
+ *     - hasBufferedLine: This function is used to check if the next line can be returned without reading.
  *     - search: This function is used to search for a string in the current directory or in a file.
- *     - searchInDirectory: This function is used to search for a string in a directory.
+ *     - runSearch: This function is used to search the files of a directory in parallel and print the matches in path order.
+ *     - searchEnumerator: This function is run by the thread that finds the files to be searched.
+ *     - searchWorker: This function is run by the threads that search the files.
+ *     - searchInDirectory: This function is used to find the files to be searched in a directory.
+ *     - queueSearchFile: This function is used to give a file to the workers of the search.
+ *     - takeSearchFile: This function is used to take a file from the deque of a worker, or to steal one from another worker.
  *     - searchInFile: This function is used to search for a string in a file.
+ *     - appendSearchResult: This function is used to append bytes to the output of a searched file.
+ *     - writeOutput, flushOutput: These functions are used to write the search output through one large buffer.
+ *     - countNewlines: This function is used to count the newlines in a part of a buffer, to find line numbers.
+ *     - isSearchedFile: This function is used to check if a file matches the include and exclude patterns of the search.
+ *     - addGlob, matchGlobSet, freeGlobSet: These functions are used to compile and match the file patterns of the search.
+ *     - loadIgnoreFile, freeIgnoreFile: These functions are used to read and free the .gitignore file of a directory.
+ *     - isIgnored: This function is used to check if a file or directory is ignored by the .gitignore files.
+ *     - compareNames: This function is used to sort directory entries by name.
+ *     - openSearchIndex, closeSearchIndex: These functions are used to map and unmap the trigram index of a directory.
+ *     - findIndexedFile, findIndexedTrigram: These functions are used to look up a file or a trigram in the index.
+ *     - findIndexCandidates: This function is used to intersect the posting lists of the trigrams of the search string.
+ *     - isIndexCandidate: This function is used to check if a file has to be searched when the index is used.
+ *     - loadPreviousTrigrams: This function is used to recover the trigrams of the files of the previous index.
+ *     - indexSearchFile: This function is used to find the trigrams of a file.
+ *     - compareSearchFiles: This function is used to sort the indexed files by path.
+ *     - writeSearchIndex: This function is used to write the trigram index.
+ *     - findSubstringScalar, findSubstringSse2, findSubstringAvx2: These functions are the substring kernels of the search.
+ *     - selectSubstringKernel: This function is used to choose the fastest substring kernel the processor supports.
+ *     - collectBenchmarkFile: This function is used to collect the files searched by benchmarkSearch.
+ *     - benchmarkSearch: This function is used to compare the substring kernels with the fgets and strstr search.
  *     - findExecutablePath: This function is used to find the path to an executable file.
+ *     - hashCommandName: This function is used to compute the hash of a command name for the PATH cache.
+ *     - clearPathCache: This function is used to clear the PATH resolution cache.
+ *     - loadPathDirectories: This function is used to split PATH into directories and record their modification times.
+ *     - pathDirectoryChanged: This function is used to check if a directory of PATH changed since the cache was filled.
+ *     - hashCommand: This function is used to handle the hash builtin.
  *     - isExecutable: This function is used to check if a file is executable.
  *     - createProcess: This function is used to create a new process.
+ *     - spawnProcess: This function is used to start an executable with the requested input/output redirection.
+ *     - applyRedirection: This function is used to perform input/output redirection in a forked child.
+ *     - benchmarkSpawn: This function is used to measure how many processes per second each spawn backend can start.
+ *     - isPipeline: This function is used to check if the command line contains a pipe operator.
+ *     - runPipeline: This function is used to run the commands of a pipeline as one process group.
+ *     - runBuiltin: This function is used to run a builtin command, such as search, inside a pipeline stage.
+ *     - initBuiltins: This function is used to fill the perfect hash table of the builtin commands.
+ *     - hashBuiltinName: This function is used to compute the slot of a builtin name in the builtin table.
+ *     - findBuiltin: This function is used to find a builtin command.
+ *     - runBuiltinCommand: This function is used to run a builtin command in the shell process, with input/output redirection.
+ *     - cdCommand, echoCommand, pwdCommand, testCommand, trueCommand, falseCommand, exitCommand: These functions are used
+ *       to handle the cd, echo, pwd, test (and "["), true, false and exit builtins.
+ *     - evaluateTest: This function is used to evaluate the expression of the test builtin.
+ *     - waitForJob: This function is used to wait for all the processes of a foreground job.
+ *     - setTerminalOwner: This function is used to give the terminal to a process group.
  *     - handleIO: This function is used to handle input/output redirection.
- *     - removeProcess: This function is used to remove a process from the array of background processes.
- *     - sigtstpHandler: This function is used to handle the SIGTSTP signal (Ctrl+Z).
- *     - sigchldHandler: This function is used to handle the SIGCHLD signal, which is sent to a process when a child process terminates.
+ *     - initJobTable: This function is used to build the free lists of the job table.
+ *     - hasJobSpace: This function is used to check if the job table can hold one more job.
+ *     - addJob: This function is used to add a job to the job table.
+ *     - findJob: This function is used to find the job of a process in the job table.
+ *     - removeJobProcess: This function is used to remove a process that terminated from its job.
+ *     - removeJob: This function is used to remove a job from the job table.
+ *     - signalJob: This function is used to send a signal to every process of a job.
+ *     - initEvents: This function is used to set up the epoll instance the main loop waits on.
+ *     - watchInput: This function is used to start or stop watching the standard input.
+ *     - handleEvents: This function is used to wait for the events of the main loop and handle them.
+ *     - handleSignals: This function is used to handle the signals read from the signalfd.
+ *     - collectJobChanges: This function is used to collect the children that stopped or continued.
+ *     - updateJob: This function is used to record that a process of a job terminated, stopped or continued.
+ *     - reportJobs: This function is used to print the background jobs that stopped or terminated since the last prompt.
+ *     - waitChild: This function is used to collect the state change of a child along with its resource use.
+ *     - printUsage: This function is used to print the time and resources used by a command, for the time builtin.
+ *     - logJob: This function is used to write the resource use of a job to the accounting log.
+ *     - jobsCommand, fgCommand, bgCommand: These functions are used to handle the jobs, fg and bg builtins.
+ *     - findJobArgument: This function is used to find the job given to the fg and bg builtins.
+ *     - joinArguments: This function is used to record the command line for the job table.
  *     - bookmark: This function is used to handle bookmark operations.
  *     - deleteBookmark: This function is used to delete a bookmark from the bookmarks array.
  *     - listBookmark: This function is used to list all the bookmarks in the bookmarks array.
  *     - executeBookmark: This function is used to execute a bookmark from the bookmarks array.
  *     - addBookmark: This function is used to add a new bookmark to the bookmarks array.
+ *     - runBookmark: This function is used to run a bookmark through the spawn path of the shell, or through sh.
+ *     - parseBookmarkSet: This function is used to read the set of bookmarks given to "bookmark -i".
+ *     - runBookmarks: This function is used to run a set of bookmarks in parallel and print their outputs in order.
+ *     - startBookmarkRun: This function is used to start one bookmark of a parallel run, with its output going to a pipe.
+ *     - findBookmarkFile: This function is used to find the path of the bookmark file at startup.
+ *     - lockBookmarkFile: This function is used to lock the bookmark file against the other shells that change it.
+ *     - readBookmarkFile: This function is used to copy the bookmark file into memory.
+ *     - setBookmarks: This function is used to replace the bookmarks array with the lines of a copy of the bookmark file.
+ *     - loadBookmarks: This function is used to read the bookmark file, the first time a bookmark is needed.
+ *     - appendBookmark: This function is used to add a bookmark at the end of the bookmarks array.
+ *     - saveBookmarks: This function is used to rewrite the bookmark file.
+ *     - tokenizeBookmark: This function is used to split a bookmark into the arguments it is executed with.
+ *     - freeBookmark: This function is used to free a bookmark.
  *     - main: This function is used to run the shell.
  *     - checkIO: This function is used to check and handle input/output redirection in the command line arguments.
  *
@@ -52,34 +183,475 @@ int input, output, append, standardError, numberOfArguments;
 char *inputFile, *outputFile;
 char executablePath[256];
 char path[256];
-pid_t foregroundProcess;
 
-pid_t *backgroundProcesses = NULL;
-int backgroundProcessCount = 0;
-char **bookmarks = NULL;
-int bookmarkCount = 0;
+typedef struct {
+    const char *command;    /* command line, not null-terminated if it is in the copy of the bookmark file */
+    size_t length;
+    char **args;            /* arguments the bookmark is executed with, NULL until it is first executed */
+    int shellSyntax;        /* equals 1 if the bookmark uses shell syntax and is run by sh */
+    char *allocated;        /* copy of the command line the bookmark owns, NULL if it is in the copy of the file */
+    int running;            /* equals 1 while the bookmark runs, so that it cannot run itself again */
+} Bookmark;
+
+typedef struct {
+    int bookmark;           /* index of the bookmark in the bookmarks array */
+    pid_t pid;
+    int pidfd;              /* -1 once the process is reaped, or if pidfds are not supported */
+    int outputFd;           /* read end of the pipe of the standard output, -1 once it is closed */
+    int running, exited, done, skipped;
+    int status;             /* exit status, in the format of waitpid */
+    char *output;           /* standard output of the bookmark, printed once the bookmarks before it are done */
+    size_t outputLength, outputCapacity;
+    struct timespec startTime, endTime;
+} BookmarkRun;
+
+Bookmark *bookmarks = NULL;
+int bookmarkCount = 0, bookmarkCapacity = 0;
+char *bookmarkPath = NULL;
+char *bookmarkText = NULL;
+size_t bookmarkTextSize = 0;
+int bookmarksLoaded = 0;
+int runningBookmarks = 0;
+
+#define PATH_CACHE_SIZE 256 /* number of buckets of the PATH resolution cache */
+
+typedef struct PathCacheEntry {
+    struct PathCacheEntry *next;
+    int directoryIndex;     /* index of the PATH directory the executable was found in */
+    char path[256];
+    char name[];
+} PathCacheEntry;
+
+typedef struct {
+    char *name;
+    struct timespec modificationTime;
+} PathDirectory;
+
+PathCacheEntry *pathCache[PATH_CACHE_SIZE];
+PathDirectory *pathDirectories = NULL;
+int pathDirectoryCount = 0;
+char *cachedPathValue = NULL;
+unsigned long pathCacheHits = 0, pathCacheMisses = 0;
+
+#define SPAWN_POSIX 0 /* start processes with posix_spawn */
+#define SPAWN_FORK 1  /* start processes with fork and execv */
+
+int spawnBackend = SPAWN_POSIX;
+
+#define MAX_JOBS 1024           /* number of jobs the job table can hold */
+#define MAX_JOB_PROCESSES 4096  /* number of processes the job table can hold, over all jobs */
+#define JOB_HASH_SIZE 4096      /* number of buckets of the pid index of the job table, a power of 2 */
+#define JOB_COMMAND_SIZE 256    /* longest command line recorded for a job */
+
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+#define JOB_DONE 2
+
+#define EVENT_INPUT UINT64_MAX          /* epoll data of the standard input */
+#define EVENT_SIGNALS (UINT64_MAX - 1)  /* epoll data of the signalfd, a pidfd has the pid and the process entry instead */
+#define MAX_EVENTS 64                   /* number of events taken from epoll at once */
+
+typedef struct {
+    int used;
+    int state;              /* JOB_RUNNING, JOB_STOPPED or JOB_DONE */
+    int foreground;         /* equals 1 if the shell waits for the job */
+    int terminalGiven;      /* equals 1 if the terminal was given to the job */
+    int notify;             /* equals 1 if the job stopped or is done, and reportJobs has not printed it yet */
+    int timed;              /* equals 1 if the job was started with the time builtin */
+    pid_t processGroup;
+    int processCount;       /* processes of the job that are not reaped yet */
+    pid_t lastPid;          /* last process of the pipeline, whose status is the status of the job */
+    int status;             /* status of the job, as returned by waitpid */
+    int firstProcess;       /* first process of the job in jobProcesses, -1 if none is left */
+    int nextFree;           /* next free job, when the job is not used */
+    struct timespec startTime;
+    struct timespec endTime;    /* time the last process of the job terminated */
+    struct rusage usage;    /* resources used by the processes of the job that terminated, and their children */
+    char command[JOB_COMMAND_SIZE];
+} Job;
+
+typedef struct {
+    pid_t pid;              /* 0 if the entry is free */
+    int pidfd;              /* -1 if the process is reaped through SIGCHLD */
+    int job;                /* index of the job of the process in jobs */
+    int nextInBucket;       /* next process of the same bucket of jobProcessIndex, or next free process */
+    int nextInJob;          /* next process of the same job */
+} JobProcess;
+
+Job jobs[MAX_JOBS];
+JobProcess jobProcesses[MAX_JOB_PROCESSES];
+int jobProcessIndex[JOB_HASH_SIZE];
+int freeJob, freeJobProcess, freeJobProcessCount;
+int jobCount = 0;
+int notifyCount = 0;
+int foregroundJob = -1;
+int eventFd = -1, signalFd = -1;
+int inputWatchable = 0, inputWatched = 0;
+int pidfdSupported = 1;
+sigset_t originalSignalMask;
+int timeCommand = 0;
+
+typedef struct {
+    int fd;                 /* -1 if the whole input is already in the buffer, as with the -c option */
+    char *buffer;
+    size_t start;           /* first byte of the buffer not returned yet */
+    size_t length, capacity;
+    int endOfInput;
+} LineReader;
+
+LineReader inputReader = {STDIN_FILENO, NULL, 0, 0, 0, 0};
+int interactive = 1;
+int lastStatus = 0;
+int accountingLog = -1;
+char commandLine[JOB_COMMAND_SIZE];
+
+typedef struct {
+    char **args;
+    char executable[256];
+    int builtin;            /* equals 1 if the stage is run by runBuiltin in a forked child of the shell */
+    int input, output, append, standardError;
+    char *inputFile, *outputFile;
+} PipelineStage;
+
+extern char **environ;
 
 int checkIO(char **args);
 
 void search(char **args);
 
-void searchInDirectory(const char *directory, const char *string);
+#define MAX_SEARCH_WORKERS 64 /* upper limit of the number of threads that search files */
+#define SEARCH_INDEX_FILE ".search_index" /* trigram index built by "search --index" */
+#define SEARCH_INDEX_MAGIC "MYSHIDX1"
+
+#define GLOB_SUFFIX 0   /* "*" followed by plain characters, such as "*.c" */
+#define GLOB_NAME 1     /* plain characters only, such as "build" */
+#define GLOB_FNMATCH 2  /* any other pattern */
+
+typedef struct {
+    int kind;
+    const char *text;       /* suffix, name or pattern, depending on the kind */
+    size_t length;
+    char *allocated;
+} GlobPattern;
+
+typedef struct {
+    GlobPattern *patterns;
+    int count;
+} GlobSet;
+
+typedef struct {
+    GlobSet include;        /* "--include": files to be searched, .c and .h files if empty */
+    GlobSet exclude;        /* "--exclude": files not to be searched */
+    GlobSet excludeDirectories; /* "--exclude-dir": directories not to be entered */
+    int noIgnore;           /* "--no-ignore": .gitignore files are not read */
+} SearchFilter;
+
+typedef struct {
+    char *pattern;
+    int negated, directoryOnly, anchored;
+} IgnoreRule;
+
+typedef struct IgnoreFile {
+    struct IgnoreFile *parent;  /* ignore file of the closest parent directory that has one */
+    char *directory;        /* directory of the ignore file, the patterns are relative to it */
+    size_t directoryLength;
+    IgnoreRule *rules;
+    int ruleCount;
+} IgnoreFile;
+
+typedef struct {
+    int recursive;          /* equals 1 if the subdirectories are searched too */
+    int buildIndex;         /* equals 1 if the files are indexed instead of searched */
+    long maxMatches;        /* "-m N": the search stops after N matches, 0 means no limit */
+    int filesOnly;          /* "-l": only the paths of the files that match are printed */
+    int countOnly;          /* "--count": only the number of matching lines of every file is printed */
+    SearchFilter filter;
+} SearchOptions;
+
+typedef struct {
+    int fd;
+    char *buffer;
+    size_t length, capacity;
+} OutputWriter;
+
+#define OUTPUT_BUFFER_SIZE (1 << 20) /* size of the buffer through which the search output is written */
+
+typedef struct {
+    char magic[8];
+    uint32_t fileCount;
+    uint32_t trigramCount;
+    uint64_t postingCount;
+    uint64_t pathsSize;
+} SearchIndexHeader;
+
+typedef struct {
+    uint64_t pathOffset;    /* offset of the path in the paths section */
+    int64_t size;
+    int64_t modificationSeconds, modificationNanoseconds;
+} SearchIndexFile;
+
+typedef struct {
+    uint32_t trigram;
+    uint32_t count;         /* number of files that contain the trigram */
+    uint64_t offset;        /* offset of the first file id in the postings section */
+} SearchIndexTrigram;
+
+typedef struct {
+    char *data;             /* the whole index file, mapped into memory */
+    size_t size;
+    const SearchIndexHeader *header;
+    const SearchIndexFile *files;
+    const SearchIndexTrigram *trigrams;
+    const uint32_t *postings;
+    const char *paths;
+} SearchIndex;
+
+typedef struct {
+    char *path;
+    char *result;           /* output lines of the file, printed once the file is done */
+    size_t resultLength, resultCapacity;
+    int done;
+    long matchCount;        /* number of matching lines found in the file */
+    uint32_t *trigrams;     /* distinct trigrams of the file, when building the index */
+    int trigramCount;
+    int indexed, reused;    /* the file was indexed, and its trigrams came from the previous index */
+    off_t size;
+    struct timespec modificationTime;
+} SearchFile;
+
+typedef struct {
+    SearchFile **items;     /* circular buffer of the files queued for one worker */
+    int head, count, capacity;
+    pthread_mutex_t lock;
+} SearchDeque;
+
+typedef struct {
+    const char *directory;
+    const char *string;
+    int recursive;
+    const SearchFilter *filter;
+    int buildIndex;
+    long maxMatches;
+    int filesOnly, countOnly;
+    int cancelled;          /* set once the output is complete, so that the threads stop early */
+    SearchIndex index;      /* index used by the query, or previous index when building */
+    unsigned char *candidates;  /* indexed files that contain every trigram of the string */
+    uint64_t *previousOffsets;  /* trigrams of the files of the previous index, when building */
+    uint32_t *previousTrigrams;
+    int workerCount;
+    SearchDeque *deques;
+    int nextDeque;          /* deque that receives the next file, only used by the enumerator */
+    pthread_mutex_t lock;   /* protects the fields below */
+    pthread_cond_t workAvailable, fileDone;
+    SearchFile **files;     /* every queued file, in output order */
+    int fileCount, fileCapacity;
+    int queuedCount;        /* files queued but not taken by a worker yet, -1 for a file taken before it is counted */
+    int enumerationDone;
+} SearchState;
+
+typedef struct {
+    SearchState *search;
+    int index;
+    unsigned char *trigramSeen; /* bitmap of the trigrams already found in the file being indexed */
+} SearchWorker;
+
+typedef struct {
+    char *name;
+    unsigned char type;     /* DT_DIR or DT_REG */
+} DirectoryEntry;
+
+void runSearch(const char *directory, const char *string, const SearchOptions *options);
+
+int openSearchIndex(const char *directory, SearchIndex *index);
+
+void closeSearchIndex(SearchIndex *index);
+
+long findIndexedFile(const SearchIndex *index, const char *path);
+
+const SearchIndexTrigram *findIndexedTrigram(const SearchIndex *index, uint32_t trigram);
+
+unsigned char *findIndexCandidates(const SearchIndex *index, const char *string);
+
+int isIndexCandidate(SearchState *search, SearchFile *file);
+
+void loadPreviousTrigrams(SearchState *search);
+
+void indexSearchFile(SearchWorker *worker, SearchFile *file);
+
+int compareSearchFiles(const void *first, const void *second);
+
+void writeSearchIndex(SearchState *search);
+
+void *searchEnumerator(void *argument);
+
+void *searchWorker(void *argument);
+
+void searchInDirectory(SearchState *search, int directoryFd, const char *directory, IgnoreFile *ignoreFile);
+
+void queueSearchFile(SearchState *search, const char *path);
+
+SearchFile *takeSearchFile(SearchDeque *deque, int steal);
+
+void searchInFile(SearchState *search, SearchFile *file);
+
+int writeOutput(OutputWriter *writer, const char *data, size_t length);
+
+int flushOutput(OutputWriter *writer);
+
+void appendSearchResult(SearchFile *file, const char *data, size_t length);
+
+long countNewlines(const char *start, const char *end);
+
+int isSearchedFile(const SearchFilter *filter, const char *name);
+
+void addGlob(GlobSet *set, const char *pattern);
+
+int matchGlobSet(const GlobSet *set, const char *name);
+
+void freeGlobSet(GlobSet *set);
+
+void freeSearchFilter(SearchFilter *filter);
 
-void searchInFile(char *filePath, const char *args);
+IgnoreFile *loadIgnoreFile(int directoryFd, const char *directory, IgnoreFile *parent);
+
+void freeIgnoreFile(IgnoreFile *ignoreFile);
+
+int isIgnored(const IgnoreFile *ignoreFile, const char *path, const char *name, int isDirectory);
+
+int compareNames(const void *first, const void *second);
+
+typedef const char *(*SubstringFinder)(const char *haystack, size_t length, const char *needle, size_t needleLength);
+
+SubstringFinder findSubstring = NULL;   /* substring kernel of the search, chosen by selectSubstringKernel */
+char **benchmarkFiles = NULL;           /* files of the corpus of benchmarkSearch */
+int benchmarkFileCount = 0;
+double benchmarkBytes = 0;
+
+const char *findSubstringScalar(const char *haystack, size_t length, const char *needle, size_t needleLength);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+const char *findSubstringSse2(const char *haystack, size_t length, const char *needle, size_t needleLength);
+
+const char *findSubstringAvx2(const char *haystack, size_t length, const char *needle, size_t needleLength);
+
+#endif
+
+void selectSubstringKernel();
+
+int collectBenchmarkFile(const char *filePath, const struct stat *st, int type, struct FTW *ftw);
+
+void benchmarkSearch(const char *directory, const char *string);
 
 void findExecutablePath(const char *executable);
 
+unsigned int hashCommandName(const char *name);
+
+void clearPathCache();
+
+void loadPathDirectories(const char *pathValue);
+
+int pathDirectoryChanged(int index);
+
+void hashCommand(char **args);
+
+typedef struct {
+    const char *name;
+    void (*function)(char **args);
+    int pipeline;           /* equals 1 if the builtin can be a pipeline stage, run in a forked child of the shell */
+} Builtin;
+
+#define BUILTIN_TABLE_SIZE 32   /* number of slots of the builtin table, a power of 2 */
+
+void initBuiltins();
+
+unsigned int hashBuiltinName(const char *name, size_t length);
+
+const Builtin *findBuiltin(const char *name);
+
+void runBuiltinCommand(const Builtin *builtin, char **args);
+
+void cdCommand(char **args);
+
+void echoCommand(char **args);
+
+void pwdCommand(char **args);
+
+int evaluateTest(char **args, int count);
+
+void testCommand(char **args);
+
+void trueCommand(char **args);
+
+void falseCommand(char **args);
+
+void exitCommand(char **args);
+
 int isExecutable(const char *path);
 
 void createProcess(char **args, int background);
 
-void handleIO(char **args);
+pid_t spawnProcess(const char *executable, char **args, int inputFd, int outputFd, pid_t *processGroup);
 
-void removeProcess(pid_t pid);
+int isPipeline(char **args);
 
-void sigtstpHandler();
+void runPipeline(char **args, int background);
 
-void sigchldHandler();
+int runBuiltin(char **args);
+
+void waitForJob(int job);
+
+void setTerminalOwner(pid_t processGroup);
+
+int applyRedirection();
+
+int benchmarkSpawn(int count, int megabytes);
+
+void handleIO(char **args, int background);
+
+void initJobTable();
+
+int hasJobSpace(int processCount);
+
+int addJob(pid_t processGroup, const pid_t *pids, int processCount, int foreground);
+
+int findJob(pid_t pid);
+
+void removeJobProcess(pid_t pid);
+
+void removeJob(int index);
+
+void signalJob(int index, int signalNumber);
+
+void initEvents();
+
+void watchInput(int enabled);
+
+void handleEvents(int job);
+
+void handleSignals();
+
+void collectJobChanges(int exited);
+
+void updateJob(const siginfo_t *info, const struct rusage *usage);
+
+void reportJobs();
+
+int waitChild(idtype_t type, id_t id, siginfo_t *info, int options, struct rusage *usage);
+
+void printUsage(double seconds, const struct rusage *usage);
+
+void logJob(int index);
+
+int findJobArgument(char **args);
+
+void jobsCommand(char **args);
+
+void fgCommand(char **args);
+
+void bgCommand(char **args);
+
+void joinArguments(char **args);
 
 void bookmark(char **args);
 
@@ -91,76 +663,200 @@ void executeBookmark(char **args);
 
 void addBookmark(char **args);
 
-#define MAX_LINE 80 /* 80 chars per line, per command, should be enough. */
+void runBookmark(int index);
+
+int *parseBookmarkSet(const char *text, int *count);
+
+void runBookmarks(const int *indexes, int count, int jobLimit, int failFast);
+
+int startBookmarkRun(BookmarkRun *run, int nullFd);
+
+void findBookmarkFile();
+
+int lockBookmarkFile();
+
+char *readBookmarkFile(size_t *size);
+
+void setBookmarks(char *text, size_t size);
+
+void loadBookmarks();
+
+void appendBookmark(const char *command, size_t length, char *allocated);
+
+int saveBookmarks(const char *text, size_t size);
+
+void tokenizeBookmark(Bookmark *bookmark);
+
+void freeBookmark(Bookmark *bookmark);
+
+char *readLine(LineReader *reader);
+
+int hasBufferedLine(const LineReader *reader);
+
+Builtin builtins[] = {
+        {"search",   search,       1},
+        {"bookmark", bookmark,     1},
+        {"hash",     hashCommand,  1},
+        {"jobs",     jobsCommand,  0},
+        {"fg",       fgCommand,    0},
+        {"bg",       bgCommand,    0},
+        {"exit",     exitCommand,  0},
+        {"cd",       cdCommand,    0},
+        {"echo",     echoCommand,  1},
+        {"pwd",      pwdCommand,   1},
+        {"test",     testCommand,  1},
+        {"[",        testCommand,  1},
+        {"true",     trueCommand,  1},
+        {"false",    falseCommand, 1},
+};
+const Builtin *builtinTable[BUILTIN_TABLE_SIZE];
+
+#define INITIAL_LINE_SIZE 4096 /* initial size of the buffer of the line reader, which grows for longer lines */
+
+/**
+ * This function is used to check if the line reader can return a line without reading.
+ *
+ * @param reader The line reader.
+ * @return Returns 1 if a whole line is buffered, or the end of the input was reached, 0 otherwise, which includes a
+ *         reader whose buffer is not allocated yet.
+ */
+int hasBufferedLine(const LineReader *reader) {
+    if (reader->endOfInput)
+        return 1;
+    if (reader->buffer == NULL)
+        return 0;
+    return memchr(reader->buffer + reader->start, '\n', reader->length - reader->start) != NULL;
+}
+
+/**
+ * This function is used to read the next line of the input.
+ *
+ * @param reader The line reader.
+ * @return Returns the line, without its newline, as a null-terminated string inside the buffer of the reader,
+ *         or NULL at the end of the input. The line is valid until the next call.
+ *
+ * Every read fills as much of the buffer as it can, so a piped input that holds many lines is read with a few large reads
+ * and the lines are then returned one by one from the buffer. The bytes that follow a line stay in the buffer for the next
+ * call. When the buffer holds no whole line, the bytes not returned yet are moved to its start, and the buffer is doubled
+ * if it is full, so a line can be of any length. A last line without a newline is returned at the end of the input.
+ */
+char *readLine(LineReader *reader) {
+    while (1) {
+        char *newline = memchr(reader->buffer + reader->start, '\n', reader->length - reader->start);
+        if (newline != NULL) {
+            char *line = reader->buffer + reader->start;
+            *newline = '\0';
+            reader->start = newline + 1 - reader->buffer;
+            return line;
+        }
+        if (reader->endOfInput) {
+            if (reader->start == reader->length)
+                return NULL;
+            char *line = reader->buffer + reader->start;
+            reader->buffer[reader->length] = '\0';
+            reader->start = reader->length;
+            return line;
+        }
+
+        if (reader->start > 0) {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->length - reader->start);
+            reader->length -= reader->start;
+            reader->start = 0;
+        }
+        // one byte is kept for the null character of a last line without a newline
+        if (reader->length + 1 >= reader->capacity) {
+            reader->capacity = reader->capacity == 0 ? INITIAL_LINE_SIZE : reader->capacity * 2;
+            reader->buffer = realloc(reader->buffer, reader->capacity);
+            if (reader->buffer == NULL) {
+                fprintf(stderr, "Error reallocating memory for the command line\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (reader->fd == -1) {
+            reader->endOfInput = 1;
+            continue;
+        }
+        ssize_t length = read(reader->fd, reader->buffer + reader->length, reader->capacity - reader->length - 1);
+        if (length < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("error reading the command");
+            exit(-1); /* terminate with error code of -1 */
+        }
+        if (length == 0)
+            reader->endOfInput = 1; /* ^d was entered, end of user command stream */
+        reader->length += length;
+    }
+}
 
 /* The setup function below will not return any value, but it will just: read
-in the next command line; separate it into distinct arguments (using blanks as
-delimiters), and set the args array entries to point to the beginning of what
-will become null-terminated, C-style strings. */
+in the next command line with readLine; separate it into distinct arguments
+(using blanks as delimiters), and set the args array entries to point to the
+beginning of what will become null-terminated, C-style strings. The args array
+grows with the number of arguments, so a line may be of any length. */
 
-void setup(char inputBuffer[], char *args[], int *background) {
+void setup(LineReader *reader, char ***args, int *background) {
+    static char **arguments = NULL; /* argument array, reused for every line */
+    static size_t argumentCapacity = 0;
     int length, /* # of characters in the command line */
-    i,      /* loop index for accessing inputBuffer array */
+    i,      /* loop index for accessing the line */
     start,  /* index where beginning of next command parameter is */
     ct;     /* index of where to place the next parameter into args[] */
 
     ct = 0;
 
-    /* read what the user enters on the command line */
-    length = read(STDIN_FILENO, inputBuffer, MAX_LINE);
-
-    /* 0 is the system predefined file descriptor for stdin (standard input),
-       which is the user's screen in this case. inputBuffer by itself is the
-       same as &inputBuffer[0], i.e. the starting address of where to store
-       the command that is read, and length holds the number of characters
-       read in. inputBuffer is not a null terminated C-string. */
-
-    start = -1;
-    if (length == 0)
-        exit(0); /* ^d was entered, end of user command stream */
-
-    /* the signal interrupted the read system call */
-    /* if the process is in the read() system call, read returns -1
-      However, if this occurs, errno is set to EINTR. We can check this  value
-      and disregard the -1 value */
-    if ((length < 0) && (errno != EINTR)) {
-        perror("error reading the command");
-        exit(-1); /* terminate with error code of -1 */
+    char *line = readLine(reader);
+    if (line == NULL) {
+        /* end of user command stream: a script ends with the status of its last command */
+        fflush(stdout);
+        if (interactive)
+            exit(0);
+        exit(WIFEXITED(lastStatus) ? WEXITSTATUS(lastStatus) : 128 + WTERMSIG(lastStatus));
     }
 
-    for (i = 0; i < length; i++) { /* examine every character in the inputBuffer */
+    length = (int) strlen(line);
+    start = -1;
+    for (i = 0; i <= length; i++) { /* examine every character of the line, and its end */
+        if ((size_t) ct + 2 > argumentCapacity) {
+            argumentCapacity = argumentCapacity == 0 ? 64 : argumentCapacity * 2;
+            arguments = realloc(arguments, argumentCapacity * sizeof(char *));
+            if (arguments == NULL) {
+                fprintf(stderr, "Error reallocating memory for arguments\n");
+                exit(EXIT_FAILURE);
+            }
+        }
 
-        switch (inputBuffer[i]) {
+        switch (i == length ? '\n' : line[i]) {
             case ' ':
             case '\t': /* argument separators */
                 if (start != -1) {
-                    args[ct] = &inputBuffer[start]; /* set up pointer */
+                    arguments[ct] = &line[start]; /* set up pointer */
                     ct++;
                 }
-                inputBuffer[i] = '\0'; /* add a null char; make a C string */
+                line[i] = '\0'; /* add a null char; make a C string */
                 start = -1;
                 break;
 
-            case '\n': /* should be the final char examined */
+            case '\n': /* the end of the line, which readLine replaced with a null char */
                 if (start != -1) {
-                    args[ct] = &inputBuffer[start];
+                    arguments[ct] = &line[start];
                     ct++;
                 }
-                inputBuffer[i] = '\0';
-                args[ct] = NULL; /* no more arguments to this command */
                 break;
 
             default: /* some other character */
                 if (start == -1)
                     start = i;
-                if (inputBuffer[i] == '&') {
+                if (line[i] == '&') {
                     *background = 1;
-                    inputBuffer[i - 1] = '\0';
+                    if (i > 0)
+                        line[i - 1] = '\0';
                 }
         }            /* end of switch */
     }                /* end of for */
-    args[ct] = NULL; /* just in case the input line was > 80 */
+    arguments[ct] = NULL; /* no more arguments to this command */
     numberOfArguments = ct;
+    *args = arguments;
 } /* end of setup routine */
 
 /**
@@ -170,301 +866,3161 @@ void setup(char inputBuffer[], char *args[], int *background) {
  *             The string should start with a double quote (") and end with a double quote (").
  *             For example, if the string to be searched for is "hello world", args[2] will be "\"hello" and args[3] will be "world\"".
  *
- * The function first checks if args[1] is not NULL. If it is, it prints an error message and returns.
- * Then it checks if args[1] is "-r". If it is, it calls the searchInDirectory function with the current directory and args as the arguments.
- * If it is not, it loops through the files in the current directory and checks if the file is a .c or .h file.
- * If it is, it calls the searchInFile function to search for the string in the file.
+ * The function first reads the options: "-r" makes the search recursive, and "--index" builds the trigram index of the current
+ * directory tree instead of searching, in which case no string is expected. "-m N" stops the search after N matches,
+ * "-l" prints only the paths of the files that match and "--count" prints only the number of matching lines of every file.
+ * "--include GLOB" and "--exclude GLOB" choose the files to be searched (.c and .h files by default), "--exclude-dir GLOB"
+ * keeps the search out of directories, and "--no-ignore" searches the files ignored by .gitignore files too.
+ * Then it joins the remaining arguments into the search string. After removing the double quotes, it calls the runSearch function with the current directory.
  */
 void search(char **args) {
-    if (args[1] == NULL) {
-        fprintf(stderr, "Wrong usage of search\n");
-        return;
+    SearchOptions options;
+    memset(&options, 0, sizeof(options));
+    int index = 1;
+    while (args[index] != NULL && args[index][0] == '-') {
+        if (!strcmp(args[index], "-r")) {
+            options.recursive = 1;
+        } else if (!strcmp(args[index], "--index")) {
+            options.buildIndex = 1;
+        } else if (!strcmp(args[index], "-m") && args[index + 1] != NULL && atol(args[index + 1]) > 0) {
+            options.maxMatches = atol(args[++index]);
+        } else if (!strcmp(args[index], "-l")) {
+            options.filesOnly = 1;
+        } else if (!strcmp(args[index], "--count")) {
+            options.countOnly = 1;
+        } else if (!strcmp(args[index], "--include") && args[index + 1] != NULL) {
+            addGlob(&options.filter.include, args[++index]);
+        } else if (!strcmp(args[index], "--exclude") && args[index + 1] != NULL) {
+            addGlob(&options.filter.exclude, args[++index]);
+        } else if (!strcmp(args[index], "--exclude-dir") && args[index + 1] != NULL) {
+            addGlob(&options.filter.excludeDirectories, args[++index]);
+        } else if (!strcmp(args[index], "--no-ignore")) {
+            options.filter.noIgnore = 1;
+        } else {
+            fprintf(stderr, "Wrong usage of search\n");
+            freeSearchFilter(&options.filter);
+            return;
+        }
+        index++;
     }
-    int index;
-    if (!strcmp(args[1], "-r")) {
-        if (args[2] == NULL) {
+    if (options.buildIndex) {
+        if (args[index] != NULL) {
             fprintf(stderr, "Wrong usage of search\n");
+            freeSearchFilter(&options.filter);
             return;
         }
-        index = 2;
-    } else index = 1;
+        options.recursive = 1;
+        runSearch(".", NULL, &options);
+        freeSearchFilter(&options.filter);
+        return;
+    }
+    if (args[index] == NULL) {
+        fprintf(stderr, "Wrong usage of search\n");
+        freeSearchFilter(&options.filter);
+        return;
+    }
 
-    // args[1] starts with " and the last argument ends with "
-    if (args[index][0] == '"' && args[numberOfArguments - 1][strlen(args[numberOfArguments - 1]) - 1] == '"') {
-        char directory[2] = ".";
-        DIR *dir = opendir(directory);
-
-        //recursive search
-        if (!strcmp(args[1], "-r")) {
-            char searchString[256];
-            searchString[0] = '\0';  // Initialize an empty string
-
-            int i = 2;
-            while (args[i] != NULL) {
-                strcat(searchString, args[i]);
-                if (args[i + 1] != NULL)
-                    strcat(searchString, " ");
-                i++;
-            }
-            if (strlen(searchString) < 3) {
-                fprintf(stderr, "Wrong usage of search\n");
-                return;
-            }
-            // Remove double quotes
-            memmove(searchString, searchString + 1, strlen(searchString));
-            searchString[strlen(searchString) - 1] = '\0';
-            searchInDirectory(directory, searchString);
-        } else { //non-recursive search
-            struct dirent *entry;
-            if (dir == NULL) {
-                fprintf(stderr, "Error opening directory\n");
-                return;
-            }
-            while ((entry = readdir(dir)) != NULL) {
-                if (entry->d_type == DT_REG && (strstr(entry->d_name, ".c") || strstr(entry->d_name, ".h"))) {
-                    // Concatenate args[2] to args[argc-1]
-                    char searchString[256];
-                    searchString[0] = '\0';  // Initialize an empty string
-                    int i = 1;
-                    while (args[i] != NULL) {
-                        strcat(searchString, args[i]);
-                        if (args[i + 1] != NULL)
-                            strcat(searchString, " ");
-                        i++;
-                    }
-                    if (strlen(searchString) < 3) {
-                        fprintf(stderr, "Wrong usage of search\n");
-                        return;
-                    }
-                    // Remove double quotes
-                    memmove(searchString, searchString + 1, strlen(searchString));
-                    searchString[strlen(searchString) - 1] = '\0';
-                    char path[259];
-                    sprintf(path, "./%s", entry->d_name);
-                    searchInFile(path, searchString);
-                }
-            }
+    int last = index;
+    while (args[last + 1] != NULL)
+        last++;
+
+    // args[index] starts with " and the last argument ends with "
+    if (args[index][0] != '"' || args[last][strlen(args[last]) - 1] != '"') {
+        fprintf(stderr, "Wrong usage of search\n");
+        freeSearchFilter(&options.filter);
+        return;
+    }
+
+    char searchString[256];
+    searchString[0] = '\0';  // Initialize an empty string
+    for (int i = index; args[i] != NULL; i++) {
+        if (strlen(searchString) + strlen(args[i]) + 2 > sizeof(searchString)) {
+            fprintf(stderr, "Wrong usage of search\n");
+            freeSearchFilter(&options.filter);
+            return;
         }
-        closedir(dir);
-    } else {
+        strcat(searchString, args[i]);
+        if (args[i + 1] != NULL)
+            strcat(searchString, " ");
+    }
+    if (strlen(searchString) < 3) {
         fprintf(stderr, "Wrong usage of search\n");
+        freeSearchFilter(&options.filter);
+        return;
     }
+    // Remove double quotes
+    memmove(searchString, searchString + 1, strlen(searchString));
+    searchString[strlen(searchString) - 1] = '\0';
+    runSearch(".", searchString, &options);
+    freeSearchFilter(&options.filter);
 }
 
 /**
- * This function is used to search for a string in a file.
+ * This function is used to add a glob pattern to a glob set.
  *
- * @param filePath The path to the file to be searched.
- * @param string The string to be searched for.
+ * @param set The glob set.
+ * @param pattern The pattern, such as "*.c", "build" or "test_*.h". Surrounding quotes are removed.
  *
- * The function first opens the file and checks if it is NULL.
- * If it is, it prints an error message and returns.
- * Then it loops through the lines in the file.
- * If the line contains the given string, it prints the line along with the line number and the file path.
+ * The pattern is compiled once into the fastest form that matches it: a pattern made of "*" followed by plain characters
+ * only needs its suffix to be compared, a pattern without any wildcard only needs the name to be compared,
+ * and the other patterns are matched with fnmatch.
  */
-void searchInFile(char *filePath, const char *string) {
-    char line[256];
-    FILE *file = fopen(filePath, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Cannot open file: %s\n", filePath);
-        return;
+void addGlob(GlobSet *set, const char *pattern) {
+    size_t length = strlen(pattern);
+    char *copy;
+    if (length >= 2 && (pattern[0] == '"' || pattern[0] == '\'') && pattern[length - 1] == pattern[0])
+        copy = strndup(pattern + 1, length - 2);
+    else
+        copy = strdup(pattern);
+    set->patterns = realloc(set->patterns, (set->count + 1) * sizeof(GlobPattern));
+    if (copy == NULL || set->patterns == NULL) {
+        fprintf(stderr, "Error allocating memory for search filters\n");
+        exit(EXIT_FAILURE);
     }
 
-    int lineNumber = 0;
-    while (fgets(line, sizeof(line), file) != NULL) {
-        lineNumber++;
-        if (strstr(line, string) != NULL) {
-            printf("%d: %s -> %s", lineNumber, filePath, line);
-        }
+    GlobPattern *glob = &set->patterns[set->count++];
+    glob->text = copy;
+    glob->length = strlen(copy);
+    if (copy[0] == '*' && strpbrk(copy + 1, "*?[\\") == NULL) {
+        glob->kind = GLOB_SUFFIX;
+        glob->text = copy + 1;
+        glob->length--;
+    } else if (strpbrk(copy, "*?[\\") == NULL) {
+        glob->kind = GLOB_NAME;
+    } else {
+        glob->kind = GLOB_FNMATCH;
     }
-    fclose(file);
+    glob->allocated = copy;
 }
 
 /**
- * This function is used to search for a string in a directory.
- *
- * @param directory The path to the directory to be searched.
- * @param string The string to be searched for.
+ * This function checks if a name matches any pattern of a glob set.
  *
- * The function first opens the directory and checks if it is NULL.
- * If it is, it prints an error message and returns.
- * Then it loops through the entries in the directory.
- * If the entry is a directory, it recursively calls the function for the subdirectory.
- * If the entry is a file, it checks if the file is a .c or .h file.
- * If it is, it calls the searchInFile function to search for the string in the file.
+ * @param set The glob set.
+ * @param name The name to be checked.
+ * @return Returns 1 if the name matches one of the patterns, 0 otherwise.
  */
-void searchInDirectory(const char *directory, const char *string) {
-    DIR *dir;
-    struct dirent *entry;
-
-    dir = opendir(directory);
-    if (dir == NULL) {
-        fprintf(stderr, "Error opening directory\n");
-        return;
+int matchGlobSet(const GlobSet *set, const char *name) {
+    size_t length = strlen(name);
+    for (int i = 0; i < set->count; i++) {
+        const GlobPattern *glob = &set->patterns[i];
+        if (glob->kind == GLOB_SUFFIX) {
+            if (length >= glob->length && !memcmp(name + length - glob->length, glob->text, glob->length))
+                return 1;
+        } else if (glob->kind == GLOB_NAME) {
+            if (length == glob->length && !memcmp(name, glob->text, length))
+                return 1;
+        } else if (fnmatch(glob->text, name, 0) == 0) {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-            char path[512];
-            snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+/**
+ * This function is used to free the patterns of a glob set.
+ *
+ * @param set The glob set.
+ */
+void freeGlobSet(GlobSet *set) {
+    for (int i = 0; i < set->count; i++)
+        free(set->patterns[i].allocated);
+    free(set->patterns);
+    set->patterns = NULL;
+    set->count = 0;
+}
 
-            if (entry->d_type == DT_DIR) {
-                // Recursive call for subdirectories
-                searchInDirectory(path, string);
-            } else if (entry->d_type == DT_REG && (strstr(entry->d_name, ".c") || strstr(entry->d_name, ".h"))) {
-                // Search in .c and .h files
-                searchInFile(path, string);
-            }
-        }
+/**
+ * This function is used to free the patterns of the filters of a search.
+ *
+ * @param filter The filters.
+ */
+void freeSearchFilter(SearchFilter *filter) {
+    freeGlobSet(&filter->include);
+    freeGlobSet(&filter->exclude);
+    freeGlobSet(&filter->excludeDirectories);
+}
+
+/**
+ * This function checks if a file should be searched, according to the "--include" and "--exclude" patterns.
+ *
+ * @param filter The filters of the search.
+ * @param name The name of the file.
+ * @return Returns 1 if the file should be searched, 0 otherwise.
+ *
+ * Without any "--include" pattern, the .c and .h files are searched.
+ */
+int isSearchedFile(const SearchFilter *filter, const char *name) {
+    if (filter->include.count > 0) {
+        if (!matchGlobSet(&filter->include, name))
+            return 0;
+    } else {
+        size_t length = strlen(name);
+        if (length < 2 || name[length - 2] != '.' || (name[length - 1] != 'c' && name[length - 1] != 'h'))
+            return 0;
     }
-    closedir(dir);
+    return !matchGlobSet(&filter->exclude, name);
 }
 
 /**
- * This function is used to handle input/output redirection in the command line arguments.
+ * This function is used to read the ignore file of a directory, in the .gitignore format.
  *
- * @param args The command line arguments. The redirection operator (<, >, >>, or 2>) is expected to be in one of the arguments,
- *             and the file for redirection is expected to be in the next argument. For example, if the output is to be redirected to a file named "output.txt",
- *             one of the arguments will be ">" and the next argument will be "output.txt".
+ * @param directoryFd An open file descriptor of the directory.
+ * @param directory The path of the directory, as the enumerator of the search builds it.
+ * @param parent The ignore files of the parent directories.
+ * @return Returns the ignore file of the directory, linked to the ones of the parent directories,
+ *         or parent if the directory has no .gitignore file.
  *
- * The function first resets the global variables input, output, append, and standardError to 0.
- * Then it loops through the command line arguments. If it finds a redirection operator, it sets the corresponding global variable to 1,
- * sets the global variable inputFile or outputFile to the next argument, and sets the current argument to NULL.
- * If it finds an input redirection operator (<), it sets inputFile and leaves outputFile as NULL.
- * If it finds an output redirection operator (> or >>), it sets outputFile and leaves inputFile as NULL.
- * If it finds a standard error redirection operator (2>), it sets outputFile and leaves inputFile as NULL.
- * The function returns 1 if it finds a redirection operator, and 0 otherwise.
+ * Blank lines and lines starting with "#" are skipped. A line starting with "!" brings back what an earlier pattern ignored,
+ * a pattern ending with "/" only matches directories, and a pattern with a "/" anywhere else is matched against the path
+ * relative to the directory instead of the name. A leading "**" followed by a slash is dropped, since it does not change what the pattern matches.
  */
-void handleIO(char **args) {
-    pid_t pid = fork();
-    if (pid == 0) {
-        findExecutablePath(args[0]);
-        if (!isExecutable(executablePath)) {
-            fprintf(stderr, "Error: %s is not executable\n", args[0]);
-        } else {
-            if (input == 1) {
-                freopen(inputFile, "r", stdin);
-                execv(executablePath, args);
-            } else if (output == 1) {
-                freopen(outputFile, "w", stdout);
-                execv(executablePath, args);
-            } else if (append == 1) {
-                freopen(outputFile, "a", stdout);
-                execv(executablePath, args);
-            } else if (standardError == 1) {
-                freopen(outputFile, "w", stderr);
-            }
+IgnoreFile *loadIgnoreFile(int directoryFd, const char *directory, IgnoreFile *parent) {
+    int fd = openat(directoryFd, ".gitignore", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return parent;
+    FILE *file = fdopen(fd, "r");
+    if (file == NULL) {
+        close(fd);
+        return parent;
+    }
+
+    IgnoreFile *ignoreFile = calloc(1, sizeof(IgnoreFile));
+    if (ignoreFile == NULL || (ignoreFile->directory = strdup(directory)) == NULL) {
+        fprintf(stderr, "Error allocating memory for search filters\n");
+        exit(EXIT_FAILURE);
+    }
+    ignoreFile->parent = parent;
+    ignoreFile->directoryLength = strlen(directory);
+
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+    while ((length = getline(&line, &lineCapacity, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' '))
+            line[--length] = '\0';
+        char *pattern = line;
+        if (length == 0 || pattern[0] == '#')
+            continue;
+
+        IgnoreRule rule;
+        memset(&rule, 0, sizeof(rule));
+        if (pattern[0] == '!') {
+            rule.negated = 1;
+            pattern++;
+        }
+        if (!strncmp(pattern, "**/", 3))
+            pattern += 3;
+        size_t patternLength = strlen(pattern);
+        if (patternLength > 0 && pattern[patternLength - 1] == '/') {
+            rule.directoryOnly = 1;
+            pattern[--patternLength] = '\0';
+        }
+        if (pattern[0] == '/') {
+            rule.anchored = 1;
+            pattern++;
+        } else if (strchr(pattern, '/') != NULL) {
+            rule.anchored = 1;
+        }
+        if (pattern[0] == '\0')
+            continue;
+        if ((rule.pattern = strdup(pattern)) == NULL) {
+            fprintf(stderr, "Error allocating memory for search filters\n");
+            exit(EXIT_FAILURE);
+        }
+        ignoreFile->rules = realloc(ignoreFile->rules, (ignoreFile->ruleCount + 1) * sizeof(IgnoreRule));
+        if (ignoreFile->rules == NULL) {
+            fprintf(stderr, "Error allocating memory for search filters\n");
+            exit(EXIT_FAILURE);
+        }
+        ignoreFile->rules[ignoreFile->ruleCount++] = rule;
+    }
+    free(line);
+    fclose(file);
+    return ignoreFile;
+}
+
+/**
+ * This function is used to free the ignore file of a directory.
+ *
+ * @param ignoreFile The ignore file. Its parents are not freed, since they belong to the parent directories.
+ */
+void freeIgnoreFile(IgnoreFile *ignoreFile) {
+    for (int i = 0; i < ignoreFile->ruleCount; i++)
+        free(ignoreFile->rules[i].pattern);
+    free(ignoreFile->rules);
+    free(ignoreFile->directory);
+    free(ignoreFile);
+}
+
+/**
+ * This function checks if an entry is ignored by the ignore files of its directory and of the parent directories.
+ *
+ * @param ignoreFile The innermost ignore file.
+ * @param path The path of the entry, as the enumerator of the search builds it.
+ * @param name The name of the entry.
+ * @param isDirectory Equals 1 if the entry is a directory.
+ * @return Returns 1 if the entry is ignored, 0 otherwise.
+ *
+ * As in git, the ignore file of the deepest directory takes precedence, and in each file the last matching pattern wins.
+ */
+int isIgnored(const IgnoreFile *ignoreFile, const char *path, const char *name, int isDirectory) {
+    for (; ignoreFile != NULL; ignoreFile = ignoreFile->parent) {
+        const char *relativePath = path + ignoreFile->directoryLength + 1;
+        for (int i = ignoreFile->ruleCount - 1; i >= 0; i--) {
+            const IgnoreRule *rule = &ignoreFile->rules[i];
+            if (rule->directoryOnly && !isDirectory)
+                continue;
+            int matched = rule->anchored ? fnmatch(rule->pattern, relativePath, FNM_PATHNAME) == 0
+                                         : fnmatch(rule->pattern, name, 0) == 0;
+            if (matched)
+                return !rule->negated;
+        }
+    }
+    return 0;
+}
+
+/**
+ * This function is used to append bytes to the output of a searched file.
+ *
+ * @param file The searched file whose output is extended.
+ * @param data The bytes to be appended.
+ * @param length The number of bytes to be appended.
+ */
+void appendSearchResult(SearchFile *file, const char *data, size_t length) {
+    if (file->resultLength + length > file->resultCapacity) {
+        size_t capacity = file->resultCapacity == 0 ? 4096 : file->resultCapacity;
+        while (capacity < file->resultLength + length)
+            capacity *= 2;
+        file->result = realloc(file->result, capacity);
+        if (file->result == NULL) {
+            fprintf(stderr, "Error reallocating memory for search results\n");
+            exit(EXIT_FAILURE);
+        }
+        file->resultCapacity = capacity;
+    }
+    memcpy(file->result + file->resultLength, data, length);
+    file->resultLength += length;
+}
+
+/**
+ * This function is used to count the newline characters in a part of a buffer.
+ *
+ * @param start The first byte to be examined.
+ * @param end The byte after the last byte to be examined.
+ * @return Returns the number of newline characters between start and end.
+ */
+long countNewlines(const char *start, const char *end) {
+    long count = 0;
+    while (start < end && (start = memchr(start, '\n', end - start)) != NULL) {
+        count++;
+        start++;
+    }
+    return count;
+}
+
+/**
+ * This function is used to search for a string in a file.
+ *
+ * @param search The running search, which holds the string and the options.
+ * @param file The file to be searched. Its output is stored in file->result, and its number of matching lines in file->matchCount.
+ *
+ * The function maps the whole file into memory and looks for the string in the whole buffer at once with the substring kernel
+ * chosen by selectSubstringKernel, so lines of any length are matched. For every match, it finds the line around the match
+ * and counts the newlines only up to that line, starting from the previous match, to get the line number. Then it stores
+ * the line along with the line number and the file path, and continues the search after the end of the line,
+ * so that every line is reported once.
+ *
+ * With "-l" the search stops at the first match and only the path is stored. With "--count" only the number of matching lines
+ * is stored. With "-m N" the search stops after N matches, since the remaining ones could not be printed anyway.
+ * The search also stops as soon as runSearch cancels it.
+ */
+void searchInFile(SearchState *search, SearchFile *file) {
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Cannot open file: %s\n", file->path);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    size_t size = (size_t) st.st_size;
+    char *buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED) {
+        fprintf(stderr, "Cannot open file: %s\n", file->path);
+        return;
+    }
+    madvise(buffer, size, MADV_SEQUENTIAL);
+
+    const char *string = search->string;
+    size_t stringLength = strlen(string);
+    const char *end = buffer + size;
+    const char *counted = buffer;   /* newlines before this position are already counted */
+    long lineNumber = 1;
+    const char *position = buffer;
+    const char *match;
+    while (!__atomic_load_n(&search->cancelled, __ATOMIC_RELAXED) &&
+           (match = findSubstring(position, end - position, string, stringLength)) != NULL) {
+        const char *lineEnd = memchr(match, '\n', end - match);
+        lineEnd = lineEnd == NULL ? end : lineEnd + 1;
+        file->matchCount++;
+        if (search->filesOnly) {
+            appendSearchResult(file, file->path, strlen(file->path));
+            appendSearchResult(file, "\n", 1);
+            break;
+        }
+        if (!search->countOnly) {
+            const char *lineStart = memrchr(position, '\n', match - position);
+            lineStart = lineStart == NULL ? position : lineStart + 1;
+            lineNumber += countNewlines(counted, lineStart);
+            counted = lineStart;
+
+            char prefix[64];
+            int prefixLength = snprintf(prefix, sizeof(prefix), "%ld: ", lineNumber);
+            appendSearchResult(file, prefix, prefixLength);
+            appendSearchResult(file, file->path, strlen(file->path));
+            appendSearchResult(file, " -> ", 4);
+            appendSearchResult(file, lineStart, lineEnd - lineStart);
+            if (lineEnd == end && end[-1] != '\n')
+                appendSearchResult(file, "\n", 1);
+        }
+        if (search->maxMatches > 0 && file->matchCount >= search->maxMatches)
+            break;
+        position = lineEnd;
+    }
+    munmap(buffer, size);
+}
+
+/**
+ * This function is used to write bytes through a buffered writer.
+ *
+ * @param writer The writer.
+ * @param data The bytes to be written.
+ * @param length The number of bytes to be written.
+ * @return Returns 0 on success, -1 if the file descriptor of the writer cannot be written anymore (for example a closed pipe).
+ *
+ * The bytes are gathered in the buffer of the writer, which is written with a single write call when it is full.
+ * Data larger than the buffer is written directly, without being copied.
+ */
+int writeOutput(OutputWriter *writer, const char *data, size_t length) {
+    if (writer->length + length > writer->capacity) {
+        if (flushOutput(writer) == -1)
+            return -1;
+        if (length >= writer->capacity) {
+            OutputWriter direct = {writer->fd, (char *) data, length, length};
+            return flushOutput(&direct);
+        }
+    }
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+    return 0;
+}
+
+/**
+ * This function is used to write the bytes gathered in a buffered writer.
+ *
+ * @param writer The writer.
+ * @return Returns 0 on success, -1 if the file descriptor of the writer cannot be written anymore.
+ */
+int flushOutput(OutputWriter *writer) {
+    size_t written = 0;
+    while (written < writer->length) {
+        ssize_t result = write(writer->fd, writer->buffer + written, writer->length - written);
+        if (result == -1 && errno == EINTR)
+            continue;
+        if (result <= 0) {
+            writer->length = 0;
+            return -1;
+        }
+        written += result;
+    }
+    writer->length = 0;
+    return 0;
+}
+
+/**
+ * This function is the scalar substring kernel of the search.
+ *
+ * @param haystack The buffer to be searched.
+ * @param length The number of bytes in the buffer.
+ * @param needle The string to be searched for.
+ * @param needleLength The number of bytes in the string, at least 1.
+ * @return Returns a pointer to the first occurrence of the string in the buffer, or NULL if there is none.
+ *
+ * The function jumps between occurrences of the first byte of the string with memchr, and compares the last byte
+ * before comparing the whole string.
+ */
+const char *findSubstringScalar(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    if (needleLength > length)
+        return NULL;
+    const char *last = haystack + length - needleLength;
+    const char *candidate = haystack;
+    while (candidate <= last && (candidate = memchr(candidate, needle[0], last - candidate + 1)) != NULL) {
+        if (candidate[needleLength - 1] == needle[needleLength - 1] && !memcmp(candidate, needle, needleLength))
+            return candidate;
+        candidate++;
+    }
+    return NULL;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * This function is the SSE2 substring kernel of the search.
+ *
+ * It takes the same arguments as findSubstringScalar. For 16 positions at a time, it compares the byte at the position
+ * with the first byte of the string and the byte needleLength - 1 later with the last byte of the string. Only the positions
+ * where both bytes match are compared with the whole string. The positions left at the end are searched by the scalar kernel.
+ */
+__attribute__((target("sse2")))
+const char *findSubstringSse2(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    if (needleLength > length)
+        return NULL;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength - 1 + 16 <= length; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *) (haystack + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *) (haystack + i + needleLength - 1));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+        while (mask != 0) {
+            unsigned int bit = __builtin_ctz(mask);
+            if (needleLength <= 2 || !memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2))
+                return haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findSubstringScalar(haystack + i, length - i, needle, needleLength);
+}
+
+/**
+ * This function is the AVX2 substring kernel of the search.
+ *
+ * It works like findSubstringSse2, on 32 positions at a time.
+ */
+__attribute__((target("avx2")))
+const char *findSubstringAvx2(const char *haystack, size_t length, const char *needle, size_t needleLength) {
+    if (needleLength > length)
+        return NULL;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+    size_t i = 0;
+    for (; i + needleLength - 1 + 32 <= length; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *) (haystack + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *) (haystack + i + needleLength - 1));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+        while (mask != 0) {
+            unsigned int bit = __builtin_ctz(mask);
+            if (needleLength <= 2 || !memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2))
+                return haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findSubstringSse2(haystack + i, length - i, needle, needleLength);
+}
+
+#endif
+
+/**
+ * This function is used to choose the substring kernel of the search for the processor the shell runs on.
+ *
+ * The features of the processor are read with cpuid, through __builtin_cpu_supports. The AVX2 kernel is preferred,
+ * then the SSE2 kernel, and the scalar kernel is used on other processors. The choice can be forced with the
+ * MYSHELL_SEARCH_KERNEL environment variable (scalar, sse2 or avx2), for example to compare the kernels.
+ */
+void selectSubstringKernel() {
+    const char *kernel = getenv("MYSHELL_SEARCH_KERNEL");
+    findSubstring = findSubstringScalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (kernel != NULL && !strcmp(kernel, "scalar"))
+        return;
+    if (__builtin_cpu_supports("avx2") && (kernel == NULL || !strcmp(kernel, "avx2"))) {
+        findSubstring = findSubstringAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        findSubstring = findSubstringSse2;
+    }
+#else
+    (void) kernel;
+#endif
+}
+
+/**
+ * This function is used to collect the files of the benchmark corpus, through nftw.
+ */
+int collectBenchmarkFile(const char *filePath, const struct stat *st, int type, struct FTW *ftw) {
+    (void) ftw;
+    SearchFilter filter;
+    memset(&filter, 0, sizeof(filter));
+    if (type == FTW_F && S_ISREG(st->st_mode) && isSearchedFile(&filter, strrchr(filePath, '/') + 1)) {
+        benchmarkFiles = realloc(benchmarkFiles, (benchmarkFileCount + 1) * sizeof(char *));
+        if (benchmarkFiles == NULL || (benchmarkFiles[benchmarkFileCount] = strdup(filePath)) == NULL) {
+            fprintf(stderr, "Error allocating memory for benchmark\n");
+            exit(EXIT_FAILURE);
+        }
+        benchmarkFileCount++;
+        benchmarkBytes += st->st_size;
+    }
+    return 0;
+}
+
+/**
+ * This function is used to compare the substring kernels of the search with the line-by-line fgets and strstr search.
+ *
+ * @param directory The root of the corpus, every .c and .h file under it is searched.
+ * @param string The string to be searched for.
+ *
+ * Every method searches every file of the corpus on one thread and counts the matching lines. The fgets method reads the files
+ * with fgets into a 256-byte buffer and calls strstr on every line, as searchInFile did before. The other methods map the files
+ * and search the whole buffer with one of the kernels, counting lines only when there is a match. The corpus is read once
+ * before the measurements, so that all the methods find it in the page cache.
+ */
+void benchmarkSearch(const char *directory, const char *string) {
+    if (nftw(directory, collectBenchmarkFile, 64, FTW_PHYS) == -1) {
+        fprintf(stderr, "Error opening directory\n");
+        return;
+    }
+    size_t stringLength = strlen(string);
+    const char *names[] = {"fgets+strstr", "scalar", "sse2", "avx2"};
+    SubstringFinder kernels[] = {NULL, findSubstringScalar, NULL, NULL};
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        kernels[2] = findSubstringSse2;
+    if (__builtin_cpu_supports("avx2"))
+        kernels[3] = findSubstringAvx2;
+#endif
+    printf("%d files, %.1f MB\n", benchmarkFileCount, benchmarkBytes / 1e6);
+
+    for (int method = -1; method < 4; method++) { // method -1 warms up the page cache
+        if (method > 1 && kernels[method] == NULL)
+            continue;
+        long matches = 0;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < benchmarkFileCount; i++) {
+            if (method <= 0) {
+                char line[256];
+                FILE *file = fopen(benchmarkFiles[i], "r");
+                if (file == NULL)
+                    continue;
+                while (fgets(line, sizeof(line), file) != NULL) {
+                    if (strstr(line, string) != NULL)
+                        matches++;
+                }
+                fclose(file);
+                continue;
+            }
+            int fd = open(benchmarkFiles[i], O_RDONLY);
+            struct stat st;
+            if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+                if (fd != -1)
+                    close(fd);
+                continue;
+            }
+            char *buffer = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (buffer == MAP_FAILED)
+                continue;
+            const char *position = buffer, *end = buffer + st.st_size, *match;
+            while ((match = kernels[method](position, end - position, string, stringLength)) != NULL) {
+                matches++;
+                const char *lineEnd = memchr(match, '\n', end - match);
+                position = lineEnd == NULL ? end : lineEnd + 1;
+            }
+            munmap(buffer, st.st_size);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (method < 0)
+            continue;
+        double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%-13s %8ld matching lines in %.3f s (%.2f GB/s)\n", names[method], matches, seconds,
+               benchmarkBytes / seconds / 1e9);
+    }
+    for (int i = 0; i < benchmarkFileCount; i++)
+        free(benchmarkFiles[i]);
+    free(benchmarkFiles);
+}
+
+/**
+ * This function compares two directory entries by name, for sorting them with qsort.
+ */
+int compareNames(const void *first, const void *second) {
+    return strcmp(((const DirectoryEntry *) first)->name, ((const DirectoryEntry *) second)->name);
+}
+
+/**
+ * This function is used to give a file to the workers of the search.
+ *
+ * @param search The running search.
+ * @param path The path of the file to be searched.
+ *
+ * The file is pushed to the deque of one of the workers, then added to the list of files, whose order is the order of the
+ * output, and only then counted as queued and signaled, so that a worker that wakes up finds it in a deque.
+ * The deques are filled in turn, and idle workers steal from the other deques, so the files end up spread over all the workers.
+ */
+void queueSearchFile(SearchState *search, const char *path) {
+    SearchFile *file = calloc(1, sizeof(SearchFile));
+    if (file == NULL || (file->path = strdup(path)) == NULL) {
+        fprintf(stderr, "Error allocating memory for search\n");
+        exit(EXIT_FAILURE);
+    }
+
+    SearchDeque *deque = &search->deques[search->nextDeque];
+    search->nextDeque = (search->nextDeque + 1) % search->workerCount;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int capacity = deque->capacity == 0 ? 64 : deque->capacity * 2;
+        SearchFile **items = malloc(capacity * sizeof(SearchFile *));
+        if (items == NULL) {
+            fprintf(stderr, "Error allocating memory for search\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < deque->count; i++)
+            items[i] = deque->items[(deque->head + i) % deque->capacity];
+        free(deque->items);
+        deque->items = items;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->items[(deque->head + deque->count) % deque->capacity] = file;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+
+    pthread_mutex_lock(&search->lock);
+    if (search->fileCount == search->fileCapacity) {
+        search->fileCapacity = search->fileCapacity == 0 ? 256 : search->fileCapacity * 2;
+        search->files = realloc(search->files, search->fileCapacity * sizeof(SearchFile *));
+        if (search->files == NULL) {
+            fprintf(stderr, "Error reallocating memory for search\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    search->files[search->fileCount++] = file;
+    search->queuedCount++;
+    pthread_cond_broadcast(&search->workAvailable);
+    pthread_mutex_unlock(&search->lock);
+}
+
+/**
+ * This function is used to take a file from a deque of the search.
+ *
+ * @param deque The deque to take the file from.
+ * @param steal Equals 1 if the caller is not the owner of the deque. The owner takes the oldest file, so that files finish
+ *              roughly in output order, and thieves take the newest one, so that they rarely contend with the owner.
+ * @return Returns the file, or NULL if the deque is empty.
+ */
+SearchFile *takeSearchFile(SearchDeque *deque, int steal) {
+    SearchFile *file = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        if (steal) {
+            file = deque->items[(deque->head + deque->count - 1) % deque->capacity];
+        } else {
+            file = deque->items[deque->head];
+            deque->head = (deque->head + 1) % deque->capacity;
+        }
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return file;
+}
+
+/**
+ * This function is run by every worker thread of the search.
+ *
+ * @param argument A pointer to the SearchWorker of the thread.
+ * @return This function does not return a value.
+ *
+ * The worker takes files from its own deque, and steals files from the deques of the other workers when its own deque is empty.
+ * Each file is searched with searchInFile, or indexed with indexSearchFile, and marked as done, so that runSearch can print it.
+ * When a trigram index is used, the files that the index rules out are marked as done without being read. When there is no file left in any
+ * deque, the worker sleeps until the enumerator queues a new file, and returns once the enumeration is finished.
+ */
+void *searchWorker(void *argument) {
+    SearchWorker *worker = (SearchWorker *) argument;
+    SearchState *search = worker->search;
+
+    while (1) {
+        SearchFile *file = takeSearchFile(&search->deques[worker->index], 0);
+        for (int i = 1; file == NULL && i < search->workerCount; i++) {
+            file = takeSearchFile(&search->deques[(worker->index + i) % search->workerCount], 1);
+        }
+
+        if (file != NULL) {
+            pthread_mutex_lock(&search->lock);
+            search->queuedCount--;
+            pthread_mutex_unlock(&search->lock);
+
+            if (search->buildIndex)
+                indexSearchFile(worker, file);
+            else if (!__atomic_load_n(&search->cancelled, __ATOMIC_RELAXED) &&
+                     (search->candidates == NULL || isIndexCandidate(search, file)))
+                searchInFile(search, file);
+
+            pthread_mutex_lock(&search->lock);
+            file->done = 1;
+            pthread_cond_broadcast(&search->fileDone);
+            pthread_mutex_unlock(&search->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&search->lock);
+        while (search->queuedCount <= 0 && !search->enumerationDone)
+            pthread_cond_wait(&search->workAvailable, &search->lock);
+        int finished = search->queuedCount <= 0 && search->enumerationDone;
+        pthread_mutex_unlock(&search->lock);
+        if (finished)
+            return NULL;
+    }
+}
+
+/**
+ * This function is used to find the files to be searched in a directory.
+ *
+ * @param search The running search.
+ * @param directoryFd An open file descriptor of the directory.
+ * @param directory The path of the directory, used to build the paths of the files.
+ * @param ignoreFile The ignore files of the parent directories, or NULL if there is none.
+ *
+ * The function reads the entries of the directory with getdents64 and sorts them by name, so that the output order does not
+ * depend on the order of the entries on disk. Then it queues every file that matches the filters of the search. If the search is
+ * recursive, the function opens every subdirectory with openat and calls itself for it, unless the directory is excluded.
+ * Entries whose type is not reported are checked with fstatat. Unless "--no-ignore" is given, the .gitignore file of the
+ * directory is read first, and the ignored files and directories are dropped, so an ignored directory is never entered.
+ * The .git directory is never entered either.
+ * Once the search is cancelled, the remaining entries are skipped.
+ * The directory file descriptor is closed before the function returns.
+ */
+void searchInDirectory(SearchState *search, int directoryFd, const char *directory, IgnoreFile *ignoreFile) {
+    DirectoryEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    char buffer[32768];
+    long length;
+    IgnoreFile *parentIgnoreFile = ignoreFile;
+    const SearchFilter *filter = search->filter;
+
+    if (!filter->noIgnore)
+        ignoreFile = loadIgnoreFile(directoryFd, directory, ignoreFile);
+
+    while ((length = getdents64(directoryFd, buffer, sizeof(buffer))) > 0) {
+        for (long offset = 0; offset < length;) {
+            struct dirent64 *entry = (struct dirent64 *) (buffer + offset);
+            offset += entry->d_reclen;
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(directoryFd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR) {
+                if (!search->recursive || matchGlobSet(&filter->excludeDirectories, entry->d_name) ||
+                    (!filter->noIgnore && !strcmp(entry->d_name, ".git")))
+                    continue;
+            } else if (type != DT_REG || !isSearchedFile(filter, entry->d_name)) {
+                continue;
+            }
+            if (ignoreFile != NULL) {
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+                if (isIgnored(ignoreFile, path, entry->d_name, type == DT_DIR))
+                    continue;
+            }
+
+            if (count == capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                entries = realloc(entries, capacity * sizeof(DirectoryEntry));
+                if (entries == NULL) {
+                    fprintf(stderr, "Error reallocating memory for search\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            entries[count].type = type;
+            entries[count].name = strdup(entry->d_name);
+            if (entries[count].name == NULL) {
+                fprintf(stderr, "Error allocating memory for search\n");
+                exit(EXIT_FAILURE);
+            }
+            count++;
+        }
+    }
+    if (length < 0)
+        fprintf(stderr, "Error reading directory: %s\n", directory);
+
+    qsort(entries, count, sizeof(DirectoryEntry), compareNames);
+    for (int i = 0; i < count; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", directory, entries[i].name);
+        if (__atomic_load_n(&search->cancelled, __ATOMIC_RELAXED)) {
+            // the search is cancelled, nothing more is queued
+        } else if (entries[i].type == DT_DIR) {
+            int fd = openat(directoryFd, entries[i].name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd == -1) {
+                fprintf(stderr, "Error opening directory\n");
+            } else {
+                // Recursive call for subdirectories
+                searchInDirectory(search, fd, path, ignoreFile);
+            }
+        } else {
+            queueSearchFile(search, path);
+        }
+        free(entries[i].name);
+    }
+    free(entries);
+    if (ignoreFile != parentIgnoreFile)
+        freeIgnoreFile(ignoreFile);
+    close(directoryFd);
+}
+
+/**
+ * This function is run by the enumerator thread of the search.
+ *
+ * @param argument A pointer to the SearchState of the search.
+ * @return This function does not return a value.
+ *
+ * It enumerates the directory with searchInDirectory and then wakes up the workers and runSearch to tell them
+ * that no more files will be queued.
+ */
+void *searchEnumerator(void *argument) {
+    SearchState *search = (SearchState *) argument;
+
+    int fd = open(search->directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Error opening directory\n");
+    } else {
+        searchInDirectory(search, fd, search->directory, NULL);
+    }
+
+    pthread_mutex_lock(&search->lock);
+    search->enumerationDone = 1;
+    pthread_cond_broadcast(&search->workAvailable);
+    pthread_cond_broadcast(&search->fileDone);
+    pthread_mutex_unlock(&search->lock);
+    return NULL;
+}
+
+/**
+ * This function is used to open the trigram index of a directory, built by "search --index".
+ *
+ * @param directory The directory whose index is to be opened.
+ * @param index The index to be filled in.
+ * @return Returns 0 if the index was opened, -1 if there is no valid index.
+ *
+ * The index file is mapped into memory as it is, and the sections are used in place. The index is in the directory being
+ * searched, so it may come from anywhere, and it is checked before it is used: the sections must fill the file exactly,
+ * every posting must be the id of an indexed file, the posting lists of the trigrams, which must be sorted, must follow
+ * each other and fill the postings section, every path must start inside the paths section, and the paths section must
+ * end with a null byte, so that the paths can be read as strings. An index that does not pass is ignored.
+ */
+int openSearchIndex(const char *directory, SearchIndex *index) {
+    char indexPath[4096];
+    snprintf(indexPath, sizeof(indexPath), "%s/%s", directory, SEARCH_INDEX_FILE);
+    memset(index, 0, sizeof(SearchIndex));
+
+    int fd = open(indexPath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(SearchIndexHeader)) {
+        close(fd);
+        return -1;
+    }
+    index->size = (size_t) st.st_size;
+    index->data = mmap(NULL, index->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (index->data == MAP_FAILED) {
+        index->data = NULL;
+        return -1;
+    }
+
+    index->header = (const SearchIndexHeader *) index->data;
+    const SearchIndexHeader *header = index->header;
+    // every count is checked against the size of the file first, so that the sum cannot overflow
+    int valid = memcmp(header->magic, SEARCH_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                header->postingCount <= index->size / sizeof(uint32_t) && header->pathsSize <= index->size &&
+                sizeof(SearchIndexHeader) + header->fileCount * sizeof(SearchIndexFile) +
+                header->trigramCount * sizeof(SearchIndexTrigram) + header->postingCount * sizeof(uint32_t) +
+                header->pathsSize == index->size;
+    if (valid) {
+        index->files = (const SearchIndexFile *) (index->data + sizeof(SearchIndexHeader));
+        index->trigrams = (const SearchIndexTrigram *) (index->files + header->fileCount);
+        index->postings = (const uint32_t *) (index->trigrams + header->trigramCount);
+        index->paths = (const char *) (index->postings + header->postingCount);
+        valid = header->pathsSize == 0 ? header->fileCount == 0 : index->paths[header->pathsSize - 1] == '\0';
+    }
+    for (uint32_t i = 0; valid && i < header->fileCount; i++) {
+        valid = index->files[i].pathOffset < header->pathsSize;
+    }
+    // the posting lists follow each other in the order of the trigrams, which are sorted and made of three bytes
+    uint64_t postingOffset = 0;
+    for (uint32_t i = 0; valid && i < header->trigramCount; i++) {
+        const SearchIndexTrigram *entry = &index->trigrams[i];
+        valid = entry->trigram < (1 << 24) && (i == 0 || entry->trigram > index->trigrams[i - 1].trigram) &&
+                entry->offset == postingOffset && entry->count <= header->postingCount - postingOffset;
+        postingOffset += entry->count;
+    }
+    valid = valid && postingOffset == header->postingCount;
+    for (uint64_t i = 0; valid && i < header->postingCount; i++) {
+        valid = index->postings[i] < header->fileCount;
+    }
+    if (!valid) {
+        fprintf(stderr, "Ignoring invalid search index: %s\n", indexPath);
+        closeSearchIndex(index);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * This function is used to close a trigram index opened by openSearchIndex.
+ *
+ * @param index The index to be closed.
+ */
+void closeSearchIndex(SearchIndex *index) {
+    if (index->data != NULL)
+        munmap(index->data, index->size);
+    memset(index, 0, sizeof(SearchIndex));
+}
+
+/**
+ * This function is used to find a file in a trigram index.
+ *
+ * @param index The index to be searched.
+ * @param path The path of the file, as the enumerator of the search builds it.
+ * @return Returns the id of the file, or -1 if the file is not in the index. The files are sorted by path, so a binary search is used.
+ */
+long findIndexedFile(const SearchIndex *index, const char *path) {
+    long low = 0, high = (long) index->header->fileCount - 1;
+    while (low <= high) {
+        long middle = (low + high) / 2;
+        int comparison = strcmp(index->paths + index->files[middle].pathOffset, path);
+        if (comparison == 0)
+            return middle;
+        if (comparison < 0)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return -1;
+}
+
+/**
+ * This function is used to find the posting list of a trigram in a trigram index.
+ *
+ * @param index The index to be searched.
+ * @param trigram The trigram, made of three bytes, the first one being the most significant.
+ * @return Returns the entry of the trigram, or NULL if no indexed file contains it.
+ */
+const SearchIndexTrigram *findIndexedTrigram(const SearchIndex *index, uint32_t trigram) {
+    long low = 0, high = (long) index->header->trigramCount - 1;
+    while (low <= high) {
+        long middle = (low + high) / 2;
+        if (index->trigrams[middle].trigram == trigram)
+            return &index->trigrams[middle];
+        if (index->trigrams[middle].trigram < trigram)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+    return NULL;
+}
+
+/**
+ * This function is used to find the indexed files that may contain a string.
+ *
+ * @param index The index to be used.
+ * @param string The string to be searched for, at least 3 bytes long.
+ * @return Returns an array with one byte per indexed file, which is 1 if the file contains every trigram of the string.
+ *
+ * The posting lists are sorted by file id, so they are intersected by merging them, starting from the shortest one.
+ */
+unsigned char *findIndexCandidates(const SearchIndex *index, const char *string) {
+    size_t length = strlen(string);
+    unsigned char *candidates = calloc(index->header->fileCount + 1, 1);
+    const SearchIndexTrigram **lists = malloc(length * sizeof(SearchIndexTrigram *));
+    if (candidates == NULL || lists == NULL) {
+        fprintf(stderr, "Error allocating memory for search index\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int listCount = 0;
+    for (size_t i = 0; i + 3 <= length; i++) {
+        uint32_t trigram = (unsigned char) string[i] << 16 | (unsigned char) string[i + 1] << 8 | (unsigned char) string[i + 2];
+        const SearchIndexTrigram *entry = findIndexedTrigram(index, trigram);
+        if (entry == NULL) { // no indexed file contains the trigram
+            free(lists);
+            return candidates;
+        }
+        lists[listCount++] = entry;
+    }
+    if (listCount == 0) { // shorter than a trigram, every file is a candidate
+        memset(candidates, 1, index->header->fileCount);
+        free(lists);
+        return candidates;
+    }
+    int shortest = 0;
+    for (int i = 1; i < listCount; i++) {
+        if (lists[i]->count < lists[shortest]->count)
+            shortest = i;
+    }
+
+    uint32_t *result = malloc((lists[shortest]->count + 1) * sizeof(uint32_t));
+    if (result == NULL) {
+        fprintf(stderr, "Error allocating memory for search index\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t resultCount = lists[shortest]->count;
+    memcpy(result, index->postings + lists[shortest]->offset, resultCount * sizeof(uint32_t));
+    for (int i = 0; i < listCount && resultCount > 0; i++) {
+        if (i == shortest || lists[i] == lists[shortest])
+            continue;
+        const uint32_t *postings = index->postings + lists[i]->offset;
+        uint32_t kept = 0, position = 0;
+        for (uint32_t j = 0; j < resultCount; j++) {
+            while (position < lists[i]->count && postings[position] < result[j])
+                position++;
+            if (position < lists[i]->count && postings[position] == result[j])
+                result[kept++] = result[j];
+        }
+        resultCount = kept;
+    }
+    for (uint32_t i = 0; i < resultCount; i++)
+        candidates[result[i]] = 1;
+    free(result);
+    free(lists);
+    return candidates;
+}
+
+/**
+ * This function checks if a file has to be searched when the search uses a trigram index.
+ *
+ * @param search The running search.
+ * @param file The file to be checked.
+ * @return Returns 0 if the index shows that the file cannot contain the string, 1 otherwise.
+ *
+ * A file that is not in the index, or whose size or modification time changed since the index was built, is always searched,
+ * so a stale index makes the search slower, but never wrong.
+ */
+int isIndexCandidate(SearchState *search, SearchFile *file) {
+    long id = findIndexedFile(&search->index, file->path);
+    if (id < 0)
+        return 1;
+    struct stat st;
+    if (stat(file->path, &st) == -1)
+        return 1;
+    const SearchIndexFile *indexed = &search->index.files[id];
+    if (indexed->size != st.st_size || indexed->modificationSeconds != st.st_mtim.tv_sec ||
+        indexed->modificationNanoseconds != st.st_mtim.tv_nsec)
+        return 1;
+    return search->candidates[id];
+}
+
+/**
+ * This function is used to rebuild the trigram lists of the files of the previous index, for an incremental refresh.
+ *
+ * @param search The running search, whose index is the previous index.
+ *
+ * The index only stores a posting list per trigram, so the list of trigrams of every file is rebuilt by walking all the
+ * posting lists once. This is much cheaper than reading the files again.
+ */
+void loadPreviousTrigrams(SearchState *search) {
+    const SearchIndex *index = &search->index;
+    uint32_t fileCount = index->header->fileCount;
+    search->previousOffsets = calloc(fileCount + 1, sizeof(uint64_t));
+    search->previousTrigrams = malloc((index->header->postingCount + 1) * sizeof(uint32_t));
+    uint64_t *filled = calloc(fileCount + 1, sizeof(uint64_t));
+    if (search->previousOffsets == NULL || search->previousTrigrams == NULL || filled == NULL) {
+        fprintf(stderr, "Error allocating memory for search index\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < index->header->postingCount; i++)
+        search->previousOffsets[index->postings[i] + 1]++;
+    for (uint32_t i = 0; i < fileCount; i++)
+        search->previousOffsets[i + 1] += search->previousOffsets[i];
+    for (uint32_t i = 0; i < index->header->trigramCount; i++) {
+        const SearchIndexTrigram *entry = &index->trigrams[i];
+        for (uint32_t j = 0; j < entry->count; j++) {
+            uint32_t id = index->postings[entry->offset + j];
+            search->previousTrigrams[search->previousOffsets[id] + filled[id]++] = entry->trigram;
+        }
+    }
+    free(filled);
+}
+
+/**
+ * This function is used to find the trigrams of a file, for building the index.
+ *
+ * @param worker The worker that indexes the file. Its bitmap is used to drop repeated trigrams.
+ * @param file The file to be indexed. Its trigrams are stored in file->trigrams.
+ *
+ * If the previous index has the file with the same size and modification time, its trigrams are taken from there and the file
+ * is not read. Otherwise the file is mapped and every three consecutive bytes form a trigram.
+ */
+void indexSearchFile(SearchWorker *worker, SearchFile *file) {
+    SearchState *search = worker->search;
+    struct stat st;
+    if (stat(file->path, &st) == -1) {
+        fprintf(stderr, "Cannot open file: %s\n", file->path);
+        return;
+    }
+    file->size = st.st_size;
+    file->modificationTime = st.st_mtim;
+    file->indexed = 1;
+
+    if (search->index.data != NULL) {
+        long id = findIndexedFile(&search->index, file->path);
+        const SearchIndexFile *indexed = id < 0 ? NULL : &search->index.files[id];
+        if (indexed != NULL && indexed->size == st.st_size && indexed->modificationSeconds == st.st_mtim.tv_sec &&
+            indexed->modificationNanoseconds == st.st_mtim.tv_nsec) {
+            file->trigramCount = search->previousOffsets[id + 1] - search->previousOffsets[id];
+            file->trigrams = malloc((file->trigramCount + 1) * sizeof(uint32_t));
+            if (file->trigrams == NULL) {
+                fprintf(stderr, "Error allocating memory for search index\n");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(file->trigrams, search->previousTrigrams + search->previousOffsets[id], file->trigramCount * sizeof(uint32_t));
+            file->reused = 1;
+            return;
+        }
+    }
+
+    if (st.st_size < 3)
+        return;
+    int fd = open(file->path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Cannot open file: %s\n", file->path);
+        return;
+    }
+    size_t size = (size_t) st.st_size;
+    const unsigned char *buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buffer == MAP_FAILED) {
+        fprintf(stderr, "Cannot open file: %s\n", file->path);
+        return;
+    }
+    madvise((void *) buffer, size, MADV_SEQUENTIAL);
+    if (worker->trigramSeen == NULL) {
+        worker->trigramSeen = calloc(1 << 21, 1); // one bit for each of the 2^24 trigrams
+        if (worker->trigramSeen == NULL) {
+            fprintf(stderr, "Error allocating memory for search index\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int count = 0, capacity = 1024;
+    uint32_t *trigrams = malloc(capacity * sizeof(uint32_t));
+    uint32_t trigram = buffer[0] << 8 | buffer[1];
+    for (size_t i = 2; i < size && trigrams != NULL; i++) {
+        trigram = (trigram << 8 | buffer[i]) & 0xFFFFFF;
+        if (worker->trigramSeen[trigram >> 3] & (1 << (trigram & 7)))
+            continue;
+        worker->trigramSeen[trigram >> 3] |= 1 << (trigram & 7);
+        if (count == capacity) {
+            capacity *= 2;
+            trigrams = realloc(trigrams, capacity * sizeof(uint32_t));
+            if (trigrams == NULL)
+                break;
+        }
+        trigrams[count++] = trigram;
+    }
+    munmap((void *) buffer, size);
+    if (trigrams == NULL) {
+        fprintf(stderr, "Error allocating memory for search index\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++)
+        worker->trigramSeen[trigrams[i] >> 3] = 0;
+    file->trigrams = trigrams;
+    file->trigramCount = count;
+}
+
+/**
+ * This function compares two searched files by path, for sorting them with qsort.
+ */
+int compareSearchFiles(const void *first, const void *second) {
+    return strcmp((*(SearchFile *const *) first)->path, (*(SearchFile *const *) second)->path);
+}
+
+/**
+ * This function is used to write the trigram index built by "search --index".
+ *
+ * @param search The finished search, whose files all have their trigrams.
+ *
+ * The files are sorted by path and numbered in that order. The posting lists are built with a counting sort: the first pass
+ * counts the files of every trigram, and the second pass fills the lists, visiting the files in id order so that every list
+ * comes out sorted. The index is written to a temporary file which is then renamed over the old index, so that a running
+ * query never sees a half-written index.
+ *
+ * The index file is made of a header, the file table (sorted by path), the trigram table (sorted by trigram),
+ * the posting lists (file ids) and the paths, and every section is used in place after mapping the file.
+ */
+void writeSearchIndex(SearchState *search) {
+    SearchFile **files = malloc((search->fileCount + 1) * sizeof(SearchFile *));
+    uint32_t *trigramSlots = calloc(1 << 24, sizeof(uint32_t));
+    if (files == NULL || trigramSlots == NULL) {
+        fprintf(stderr, "Error allocating memory for search index\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t fileCount = 0;
+    int reusedCount = 0;
+    for (int i = 0; i < search->fileCount; i++) {
+        if (search->files[i]->indexed) {
+            files[fileCount++] = search->files[i];
+            reusedCount += search->files[i]->reused;
+        }
+    }
+    qsort(files, fileCount, sizeof(SearchFile *), compareSearchFiles);
+
+    SearchIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+    header.fileCount = fileCount;
+    for (uint32_t id = 0; id < fileCount; id++) {
+        for (int j = 0; j < files[id]->trigramCount; j++) {
+            if (trigramSlots[files[id]->trigrams[j]]++ == 0)
+                header.trigramCount++;
+        }
+        header.postingCount += files[id]->trigramCount;
+        header.pathsSize += strlen(files[id]->path) + 1;
+    }
+
+    SearchIndexTrigram *trigrams = malloc((header.trigramCount + 1) * sizeof(SearchIndexTrigram));
+    uint32_t *postings = malloc((header.postingCount + 1) * sizeof(uint32_t));
+    uint32_t *filled = calloc(header.trigramCount + 1, sizeof(uint32_t));
+    SearchIndexFile *entries = malloc((fileCount + 1) * sizeof(SearchIndexFile));
+    if (trigrams == NULL || postings == NULL || filled == NULL || entries == NULL) {
+        fprintf(stderr, "Error allocating memory for search index\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t trigramCount = 0;
+    uint64_t offset = 0;
+    for (uint32_t trigram = 0; trigram < (1 << 24); trigram++) {
+        if (trigramSlots[trigram] == 0)
+            continue;
+        trigrams[trigramCount].trigram = trigram;
+        trigrams[trigramCount].count = trigramSlots[trigram];
+        trigrams[trigramCount].offset = offset;
+        offset += trigramSlots[trigram];
+        trigramSlots[trigram] = trigramCount++; // from now on the slot holds the position in the trigram table
+    }
+    uint64_t pathOffset = 0;
+    for (uint32_t id = 0; id < fileCount; id++) {
+        for (int j = 0; j < files[id]->trigramCount; j++) {
+            uint32_t slot = trigramSlots[files[id]->trigrams[j]];
+            postings[trigrams[slot].offset + filled[slot]++] = id;
+        }
+        entries[id].pathOffset = pathOffset;
+        entries[id].size = files[id]->size;
+        entries[id].modificationSeconds = files[id]->modificationTime.tv_sec;
+        entries[id].modificationNanoseconds = files[id]->modificationTime.tv_nsec;
+        pathOffset += strlen(files[id]->path) + 1;
+    }
+
+    char indexPath[4096], temporaryPath[4096 + 16];
+    snprintf(indexPath, sizeof(indexPath), "%s/%s", search->directory, SEARCH_INDEX_FILE);
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.%d", indexPath, (int) getpid());
+    FILE *indexFile = fopen(temporaryPath, "w");
+    if (indexFile == NULL) {
+        fprintf(stderr, "Cannot open file: %s\n", temporaryPath);
+    } else {
+        setvbuf(indexFile, NULL, _IOFBF, 1 << 20);
+        fwrite(&header, sizeof(header), 1, indexFile);
+        fwrite(entries, sizeof(SearchIndexFile), fileCount, indexFile);
+        fwrite(trigrams, sizeof(SearchIndexTrigram), header.trigramCount, indexFile);
+        fwrite(postings, sizeof(uint32_t), header.postingCount, indexFile);
+        for (uint32_t id = 0; id < fileCount; id++)
+            fwrite(files[id]->path, 1, strlen(files[id]->path) + 1, indexFile);
+        // the index is synced before the rename, so a crash never leaves a truncated index in place of the old one
+        int failed = fflush(indexFile) != 0 || fsync(fileno(indexFile)) != 0;
+        if (fclose(indexFile) != 0 || failed || rename(temporaryPath, indexPath) == -1) {
+            fprintf(stderr, "Error writing search index\n");
+            unlink(temporaryPath);
+        } else {
+            printf("Indexed %u files (%d unchanged), %u trigrams\n", fileCount, reusedCount, header.trigramCount);
+        }
+    }
+    free(files);
+    free(trigramSlots);
+    free(trigrams);
+    free(postings);
+    free(filled);
+    free(entries);
+}
+
+/**
+ * This function is used to search for a string in the files of a directory, in parallel.
+ *
+ * @param directory The path to the directory to be searched.
+ * @param string The string to be searched for.
+ * @param options The options of the search.
+ *
+ * The function starts one enumerator thread, which finds the files to be searched, and one worker thread per online processor,
+ * which search the files. Meanwhile, the calling thread prints the output of the files in the order the enumerator found them,
+ * which is the sorted path order. It waits for each file to be done before printing it, so the output is the same
+ * whatever the number of workers is.
+ *
+ * The output goes through one large buffered writer straight to the standard output file descriptor. Once the number of matches
+ * given with "-m" is printed, or the output cannot be written anymore, the search is cancelled: the enumerator stops,
+ * and the workers drop the files that are still queued and stop the ones they are searching.
+ *
+ * If the directory has a trigram index and the string is at least 3 bytes long, the candidate files are found in the index
+ * first, and the workers only read those, along with the files the index does not know. When the index is being built,
+ * the workers find the trigrams of the files instead, reusing the ones of the previous index for unchanged files,
+ * and the index is written once every file is done.
+ */
+void runSearch(const char *directory, const char *string, const SearchOptions *options) {
+    SearchState search;
+    memset(&search, 0, sizeof(search));
+    search.directory = directory;
+    search.string = string;
+    search.recursive = options->recursive;
+    search.filter = &options->filter;
+    search.buildIndex = options->buildIndex;
+    search.maxMatches = options->maxMatches;
+    search.filesOnly = options->filesOnly;
+    search.countOnly = options->countOnly;
+    if (openSearchIndex(directory, &search.index) == 0) {
+        if (search.buildIndex)
+            loadPreviousTrigrams(&search);
+        else if (strlen(string) >= 3)
+            search.candidates = findIndexCandidates(&search.index, string);
+    }
+    if (findSubstring == NULL)
+        selectSubstringKernel();
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    search.workerCount = processors < 1 ? 1 : processors > MAX_SEARCH_WORKERS ? MAX_SEARCH_WORKERS : (int) processors;
+    pthread_mutex_init(&search.lock, NULL);
+    pthread_cond_init(&search.workAvailable, NULL);
+    pthread_cond_init(&search.fileDone, NULL);
+
+    SearchWorker workers[MAX_SEARCH_WORKERS];
+    pthread_t workerThreads[MAX_SEARCH_WORKERS];
+    pthread_t enumeratorThread;
+    search.deques = calloc(search.workerCount, sizeof(SearchDeque));
+    if (search.deques == NULL) {
+        fprintf(stderr, "Error allocating memory for search\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < search.workerCount; i++) {
+        pthread_mutex_init(&search.deques[i].lock, NULL);
+        workers[i].search = &search;
+        workers[i].index = i;
+        workers[i].trigramSeen = NULL;
+    }
+    // if fewer workers can be started, the files queued to the deques of the missing ones are stolen by the others
+    int startedWorkers = 0;
+    while (startedWorkers < search.workerCount &&
+           pthread_create(&workerThreads[startedWorkers], NULL, searchWorker, &workers[startedWorkers]) == 0)
+        startedWorkers++;
+    // without an enumerator thread, or without any worker, their work is done here before the output is printed
+    int enumeratorStarted = pthread_create(&enumeratorThread, NULL, searchEnumerator, &search) == 0;
+    if (!enumeratorStarted)
+        searchEnumerator(&search);
+    if (startedWorkers == 0)
+        searchWorker(&workers[0]);
+
+    // anything printed with printf before the search must come out first
+    fflush(stdout);
+    OutputWriter writer = {STDOUT_FILENO, malloc(OUTPUT_BUFFER_SIZE), 0, OUTPUT_BUFFER_SIZE};
+    if (writer.buffer == NULL) {
+        fprintf(stderr, "Error allocating memory for search output\n");
+        exit(EXIT_FAILURE);
+    }
+    long printedMatches = 0;
+    int next;
+    for (next = 0; !search.cancelled; next++) {
+        pthread_mutex_lock(&search.lock);
+        while (next < search.fileCount ? !search.files[next]->done : !search.enumerationDone)
+            pthread_cond_wait(&search.fileDone, &search.lock);
+        if (next >= search.fileCount) {
+            pthread_mutex_unlock(&search.lock);
+            break;
+        }
+        SearchFile *file = search.files[next];
+        pthread_mutex_unlock(&search.lock);
+        if (search.buildIndex || file->matchCount == 0)
+            continue;
+
+        // with "-m", only the lines that fit in the limit are printed
+        long matches = file->matchCount;
+        size_t length = file->resultLength;
+        if (search.maxMatches > 0 && printedMatches + matches >= search.maxMatches) {
+            matches = search.maxMatches - printedMatches;
+            if (!search.countOnly && !search.filesOnly) {
+                const char *line = file->result;
+                for (long i = 0; i < matches; i++)
+                    line = (const char *) memchr(line, '\n', file->result + file->resultLength - line) + 1;
+                length = line - file->result;
+            }
+        }
+        int result;
+        if (search.countOnly) {
+            char count[32];
+            int countLength = snprintf(count, sizeof(count), ": %ld\n", matches);
+            result = writeOutput(&writer, file->path, strlen(file->path));
+            if (result == 0)
+                result = writeOutput(&writer, count, countLength);
+        } else {
+            result = writeOutput(&writer, file->result, length);
+        }
+        printedMatches += matches;
+        if (result == -1 || (search.maxMatches > 0 && printedMatches >= search.maxMatches)) {
+            // the output is complete, so the files that are queued or being searched are not needed anymore
+            pthread_mutex_lock(&search.lock);
+            __atomic_store_n(&search.cancelled, 1, __ATOMIC_RELAXED);
+            pthread_cond_broadcast(&search.workAvailable);
+            pthread_mutex_unlock(&search.lock);
+        }
+    }
+    flushOutput(&writer);
+    free(writer.buffer);
+
+    if (enumeratorStarted)
+        pthread_join(enumeratorThread, NULL);
+    for (int i = 0; i < search.workerCount; i++) {
+        if (i < startedWorkers)
+            pthread_join(workerThreads[i], NULL);
+        pthread_mutex_destroy(&search.deques[i].lock);
+        free(search.deques[i].items);
+        free(workers[i].trigramSeen);
+    }
+    if (search.buildIndex)
+        writeSearchIndex(&search);
+    for (int i = 0; i < search.fileCount; i++) {
+        free(search.files[i]->result);
+        free(search.files[i]->trigrams);
+        free(search.files[i]->path);
+        free(search.files[i]);
+    }
+    fflush(stdout);
+    closeSearchIndex(&search.index);
+    free(search.candidates);
+    free(search.previousOffsets);
+    free(search.previousTrigrams);
+    free(search.deques);
+    free(search.files);
+    pthread_mutex_destroy(&search.lock);
+    pthread_cond_destroy(&search.workAvailable);
+    pthread_cond_destroy(&search.fileDone);
+}
+
+/**
+ * This function is used to run a command whose input/output is redirected.
+ *
+ * @param args The command line arguments, already cut at the redirection operator by checkIO.
+ * @param background Equals 1 if the process is to be run in the background, 0 otherwise.
+ *
+ * The function checks that a file name follows the redirection operator and that the executable found by findExecutablePath
+ * can be run. Then it starts the command with createProcess, which passes the redirection recorded by checkIO
+ * to spawnProcess, so that it is performed in the new process before the executable starts.
+ */
+void handleIO(char **args, int background) {
+    if ((input == 1 && inputFile == NULL) || (input == 0 && outputFile == NULL)) {
+        fprintf(stderr, "Error: missing file name for redirection\n");
+        return;
+    }
+    if (!isExecutable(executablePath)) {
+        fprintf(stderr, "Error: %s is not executable\n", args[0]);
+        return;
+    }
+    createProcess(args, background);
+}
+
+/**
+ * This function is used to perform the input/output redirection recorded by checkIO in a forked child.
+ *
+ * @return Returns 0 on success, -1 if the file could not be opened.
+ *
+ * The file is opened with the same modes freopen used before ("r", "w" and "a") and moved onto
+ * the standard input, output or error with dup2.
+ */
+int applyRedirection() {
+    int fd, target;
+    if (input == 1) {
+        fd = open(inputFile, O_RDONLY);
+        target = STDIN_FILENO;
+    } else if (output == 1) {
+        fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        target = STDOUT_FILENO;
+    } else if (append == 1) {
+        fd = open(outputFile, O_WRONLY | O_CREAT | O_APPEND, 0666);
+        target = STDOUT_FILENO;
+    } else if (standardError == 1) {
+        fd = open(outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        target = STDERR_FILENO;
+    } else {
+        return 0;
+    }
+    if (fd == -1 || dup2(fd, target) == -1)
+        return -1;
+    close(fd);
+    return 0;
+}
+
+/**
+ * This function is used to start an executable with the input/output redirection recorded by checkIO.
+ *
+ * @param executable The path to the executable file.
+ * @param args The command line arguments passed to the executable.
+ * @param inputFd The file descriptor to be used as the standard input of the process (a pipe between pipeline stages).
+ * @param outputFd The file descriptor to be used as the standard output of the process.
+ * @param processGroup NULL to leave the process in the process group of the shell. Otherwise the process joins the group
+ *                     *processGroup, or starts a new group if it is 0, in which case *processGroup is set to its pid.
+ * @return Returns the pid of the new process, or -1 if it could not be started.
+ *
+ * With the SPAWN_POSIX backend the process is started with posix_spawn, and the redirection is given to it as a file action,
+ * so the shell is never copied: glibc starts the child with vfork semantics no matter how big the shell has grown.
+ * With the SPAWN_FORK backend the shell forks, the child performs the redirection with applyRedirection and calls execv.
+ * The redirection recorded by checkIO is performed after inputFd and outputFd are installed, so it takes precedence over a pipe.
+ * In both cases the process starts with originalSignalMask, since the shell blocks the signals it reads from its signalfd.
+ */
+pid_t spawnProcess(const char *executable, char **args, int inputFd, int outputFd, pid_t *processGroup) {
+    pid_t pid;
+
+    // without a prompt nothing flushes the standard output between commands, and the output of the shell must come first
+    fflush(stdout);
+
+    if (spawnBackend == SPAWN_FORK) {
+        pid = fork();
+        if (pid == 0) {
+            if (processGroup != NULL)
+                setpgid(0, *processGroup);
+            sigprocmask(SIG_SETMASK, &originalSignalMask, NULL);
+            if ((inputFd != STDIN_FILENO && dup2(inputFd, STDIN_FILENO) == -1) ||
+                (outputFd != STDOUT_FILENO && dup2(outputFd, STDOUT_FILENO) == -1) ||
+                applyRedirection() == -1) {
+                fprintf(stderr, "Error redirecting input/output\n");
+                _exit(EXIT_FAILURE);
+            }
+            execv(executable, args);
+            fprintf(stderr, "Error executing command\n");
+            _exit(EXIT_FAILURE);
+        } else if (pid < 0) {
+            fprintf(stderr, "Error forking process\n");
+            return pid;
+        }
+        if (processGroup != NULL) {
+            // set the group from both sides, so it is in place whichever of the two runs first
+            setpgid(pid, *processGroup == 0 ? pid : *processGroup);
+            if (*processGroup == 0)
+                *processGroup = pid;
+        }
+        return pid;
+    }
+
+    posix_spawn_file_actions_t fileActions;
+    posix_spawnattr_t attributes;
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawnattr_init(&attributes);
+    // every step returns an error number, like posix_spawn; the first failure skips the rest and the spawn
+    int error = 0;
+    if (inputFd != STDIN_FILENO)
+        error = posix_spawn_file_actions_adddup2(&fileActions, inputFd, STDIN_FILENO);
+    if (error == 0 && outputFd != STDOUT_FILENO)
+        error = posix_spawn_file_actions_adddup2(&fileActions, outputFd, STDOUT_FILENO);
+    if (error == 0 && input == 1) {
+        error = posix_spawn_file_actions_addopen(&fileActions, STDIN_FILENO, inputFile, O_RDONLY, 0);
+    } else if (error == 0 && output == 1) {
+        error = posix_spawn_file_actions_addopen(&fileActions, STDOUT_FILENO, outputFile,
+                                                 O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    } else if (error == 0 && append == 1) {
+        error = posix_spawn_file_actions_addopen(&fileActions, STDOUT_FILENO, outputFile,
+                                                 O_WRONLY | O_CREAT | O_APPEND, 0666);
+    } else if (error == 0 && standardError == 1) {
+        error = posix_spawn_file_actions_addopen(&fileActions, STDERR_FILENO, outputFile,
+                                                 O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+    // the signals the shell reads from its signalfd are blocked, the new process gets the mask the shell started with
+    if (error == 0)
+        error = posix_spawnattr_setsigmask(&attributes, &originalSignalMask);
+    if (error == 0 && processGroup != NULL) {
+        error = posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+        if (error == 0)
+            error = posix_spawnattr_setpgroup(&attributes, *processGroup);
+    } else if (error == 0) {
+        error = posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+    }
+    if (error == 0)
+        error = posix_spawn(&pid, executable, &fileActions, &attributes, args, environ);
+    posix_spawn_file_actions_destroy(&fileActions);
+    posix_spawnattr_destroy(&attributes);
+    if (error != 0) {
+        fprintf(stderr, "Error executing command: %s\n", strerror(error));
+        return -1;
+    }
+    if (processGroup != NULL && *processGroup == 0)
+        *processGroup = pid;
+    return pid;
+}
+
+/**
+ * This function is used to measure how many processes per second each spawn backend can start.
+ *
+ * @param count The number of copies of /bin/true to start with each backend.
+ * @param megabytes The amount of memory the shell touches before measuring, to imitate a shell that has grown.
+ *
+ * For both backends the function starts /bin/true count times, waiting for each copy to terminate,
+ * and prints the elapsed time along with the number of spawns per second.
+ *
+ * @return Returns 0 on success, -1 if the count is below 1 or the memory cannot be allocated.
+ */
+int benchmarkSpawn(int count, int megabytes) {
+    char *args[] = {"true", NULL};
+    const char *names[] = {"posix_spawn", "fork"};
+    int backends[] = {SPAWN_POSIX, SPAWN_FORK};
+
+    if (count < 1) {
+        fprintf(stderr, "Error: the number of spawns must be at least 1\n");
+        return -1;
+    }
+
+    char *memory = NULL;
+    if (megabytes > 0) {
+        memory = malloc((size_t) megabytes << 20);
+        if (memory == NULL) {
+            fprintf(stderr, "Error allocating memory for benchmark\n");
+            return -1;
+        }
+        memset(memory, 1, (size_t) megabytes << 20);
+    }
+
+    input = output = append = standardError = 0;
+    for (int b = 0; b < 2; b++) {
+        spawnBackend = backends[b];
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            pid_t pid = spawnProcess("/bin/true", args, STDIN_FILENO, STDOUT_FILENO, NULL);
+            if (pid > 0)
+                waitpid(pid, NULL, 0);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%-12s %d spawns in %.3f s (%.0f spawns/s)\n", names[b], count, seconds, count / seconds);
+    }
+    free(memory);
+    return 0;
+}
+
+/**
+ * This function is used to check if the command line contains a pipe operator.
+ *
+ * @param args The command line arguments.
+ * @return Returns 1 if one of the arguments is "|", 0 otherwise.
+ */
+int isPipeline(char **args) {
+    for (int i = 0; args[i] != NULL; i++) {
+        if (!strcmp(args[i], "|"))
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * This function is used to run a builtin command in a child process of the shell, as a stage of a pipeline.
+ *
+ * @param args The command line arguments of the stage.
+ * @return Returns 1 if args[0] is a builtin that can be run in a pipeline, 0 otherwise. The exit status of the builtin
+ *         is stored in lastStatus.
+ */
+int runBuiltin(char **args) {
+    const Builtin *builtin = findBuiltin(args[0]);
+    if (builtin == NULL || !builtin->pipeline)
+        return 0;
+    lastStatus = 0;
+    builtin->function(args);
+    return 1;
+}
+
+/**
+ * This function is used to give the terminal to a process group.
+ *
+ * @param processGroup The process group that should receive the input of the terminal.
+ *
+ * SIGTTOU is blocked during the call, since the shell is not in the foreground process group when it takes the terminal back.
+ */
+void setTerminalOwner(pid_t processGroup) {
+    sigset_t mask, oldMask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &mask, &oldMask);
+    tcsetpgrp(STDIN_FILENO, processGroup);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+/**
+ * This function is used to wait for all the processes of a foreground job.
+ *
+ * @param job The index of the job in the jobs array.
+ *
+ * The job becomes the foreground job, so that SIGINT and SIGTSTP are passed on to it, and the standard input is not watched
+ * until it is done, so that a line typed ahead is left for the next prompt. The events are handled by handleEvents until
+ * every process of the job is reaped; updateJob gives the job the terminal if it reads from it, and kills it if it is stopped.
+ * Then the terminal is given back to the shell, if it was given away, the resource use of the job is printed if it was
+ * started with the time builtin, and the job is removed from the job table.
+ */
+void waitForJob(int job) {
+    jobs[job].foreground = 1;
+    foregroundJob = job;
+    watchInput(0);
+    handleEvents(job);
+    if (jobs[job].terminalGiven)
+        setTerminalOwner(getpgrp());
+    if (jobs[job].timed)
+        printUsage((double) (jobs[job].endTime.tv_sec - jobs[job].startTime.tv_sec) +
+                   (double) (jobs[job].endTime.tv_nsec - jobs[job].startTime.tv_nsec) / 1e9, &jobs[job].usage);
+    foregroundJob = -1;
+    lastStatus = jobs[job].status;
+    removeJob(job);
+}
+
+/**
+ * This function is used to run the commands of a pipeline, such as "ls -l | search \"main\" | wc -l".
+ *
+ * @param args The command line arguments. The commands of the pipeline are separated by "|" arguments.
+ * @param background Equals 1 if the pipeline is to be run in the background, 0 otherwise.
+ *
+ * The function first cuts the arguments into stages at every "|" and checks each stage with checkIO, so that every stage can
+ * have its own redirection, and with findExecutablePath. If a stage is empty or cannot be run, nothing is started.
+ * Then every stage is started with its own process, and consecutive stages are connected with a pipe created by pipe2 with
+ * O_CLOEXEC, so that no process holds a pipe end other than its own standard input and output. The processes join one
+ * process group whose id is the pid of the first stage. A builtin stage, such as search, runs in a forked child of the shell
+ * whose standard output is the pipe itself, so its output goes to the next stage without being copied by the shell.
+ * The data between two stages only moves through the kernel pipe, so there is nothing for the shell to splice.
+ * Finally the function adds the pipeline to the job table, and waits for it with waitForJob if it runs in the foreground.
+ */
+void runPipeline(char **args, int background) {
+    int stageCount = 1;
+    int argumentCount = 0;
+    while (args[argumentCount] != NULL) {
+        if (!strcmp(args[argumentCount], "|"))
+            stageCount++;
+        argumentCount++;
+    }
+    if (argumentCount > 0 && !strcmp(args[argumentCount - 1], "&"))
+        args[--argumentCount] = NULL;
+    if (!hasJobSpace(stageCount)) {
+        fprintf(stderr, "Error: too many jobs\n");
+        return;
+    }
+
+    PipelineStage *stages = calloc(stageCount, sizeof(PipelineStage));
+    pid_t *pids = calloc(stageCount, sizeof(pid_t));
+    if (stages == NULL || pids == NULL) {
+        fprintf(stderr, "Error allocating memory for pipeline\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Cut the arguments into stages
+    int stage = 0;
+    stages[0].args = args;
+    for (int i = 0; i < argumentCount; i++) {
+        if (!strcmp(args[i], "|")) {
+            args[i] = NULL;
+            stages[++stage].args = &args[i + 1];
+        }
+    }
+
+    int valid = 1;
+    for (int i = 0; i < stageCount && valid; i++) {
+        PipelineStage *current = &stages[i];
+        if (current->args[0] == NULL) {
+            fprintf(stderr, "Error: empty command in pipeline\n");
+            valid = 0;
+            break;
+        }
+        checkIO(current->args);
+        current->input = input;
+        current->output = output;
+        current->append = append;
+        current->standardError = standardError;
+        current->inputFile = inputFile;
+        current->outputFile = outputFile;
+        if ((input == 1 && inputFile == NULL) || ((output || append || standardError) && outputFile == NULL)) {
+            fprintf(stderr, "Error: missing file name for redirection\n");
+            valid = 0;
+        } else if (findBuiltin(current->args[0]) != NULL && findBuiltin(current->args[0])->pipeline) {
+            current->builtin = 1;
+        } else {
+            executablePath[0] = '\0';
+            findExecutablePath(current->args[0]);
+            if (!isExecutable(executablePath)) {
+                fprintf(stderr, "Error: %s is not executable\n", current->args[0]);
+                valid = 0;
+            }
+            strcpy(current->executable, executablePath);
+        }
+    }
+
+    pid_t processGroup = 0;
+    int processCount = 0;
+    int previousRead = STDIN_FILENO;
+    for (int i = 0; i < stageCount && valid; i++) {
+        PipelineStage *current = &stages[i];
+        int pipeFds[2] = {-1, STDOUT_FILENO};
+        if (i < stageCount - 1 && pipe2(pipeFds, O_CLOEXEC) == -1) {
+            fprintf(stderr, "Error creating pipe\n");
+            break;
+        }
+
+        input = current->input;
+        output = current->output;
+        append = current->append;
+        standardError = current->standardError;
+        inputFile = current->inputFile;
+        outputFile = current->outputFile;
+
+        pid_t pid;
+        if (current->builtin) {
+            fflush(stdout); // the child must not inherit the output of the shell that is not written yet
+            pid = fork();
+            if (pid == 0) {
+                setpgid(0, processGroup);
+                sigprocmask(SIG_SETMASK, &originalSignalMask, NULL);
+                // the epoll instance is shared with the shell, so the child must not change it
+                close(eventFd);
+                close(signalFd);
+                eventFd = signalFd = -1;
+                if ((previousRead != STDIN_FILENO && dup2(previousRead, STDIN_FILENO) == -1) ||
+                    (pipeFds[1] != STDOUT_FILENO && dup2(pipeFds[1], STDOUT_FILENO) == -1) ||
+                    applyRedirection() == -1) {
+                    fprintf(stderr, "Error redirecting input/output\n");
+                    _exit(EXIT_FAILURE);
+                }
+                // the child does not exec, so O_CLOEXEC does not close the pipe ends it inherited:
+                // holding the read end of its own output would keep it from ever seeing EPIPE
+                if (pipeFds[0] != -1)
+                    close(pipeFds[0]);
+                if (pipeFds[1] != STDOUT_FILENO)
+                    close(pipeFds[1]);
+                if (previousRead != STDIN_FILENO)
+                    close(previousRead);
+                int count = 0;
+                while (current->args[count] != NULL)
+                    count++;
+                numberOfArguments = count;
+                runBuiltin(current->args);
+                fflush(stdout);
+                _exit(WEXITSTATUS(lastStatus));
+            } else if (pid > 0) {
+                setpgid(pid, processGroup == 0 ? pid : processGroup);
+                if (processGroup == 0)
+                    processGroup = pid;
+            } else {
+                fprintf(stderr, "Error forking process\n");
+            }
+        } else {
+            pid = spawnProcess(current->executable, current->args, previousRead, pipeFds[1], &processGroup);
+        }
+
+        if (previousRead != STDIN_FILENO)
+            close(previousRead);
+        if (pipeFds[1] != STDOUT_FILENO)
+            close(pipeFds[1]);
+        previousRead = pipeFds[0];
+        if (pid > 0)
+            pids[processCount++] = pid;
+    }
+    if (previousRead != STDIN_FILENO && previousRead != -1)
+        close(previousRead);
+    input = output = append = standardError = 0;
+
+    if (processCount > 0) {
+        int job = addJob(processGroup, pids, processCount, !background);
+        if (background == 0)
+            waitForJob(job);
+        else
+            printf("[%d] %d\n", job + 1, (int) processGroup);
+    }
+    free(stages);
+    free(pids);
+}
+
+/**
+ * This function is used to create a new process.
+ *
+ * @param args The command line arguments.
+ * @param background Equals 1 if the process is to be run in the background, 0 otherwise.
+ *
+ * The function starts the executable found by findExecutablePath with spawnProcess. If it cannot be started, it returns.
+ * The process is added to the job table. If it is not to be run in the background, the function waits for it with waitForJob.
+ * If it is, the process is started in a process group of its own, so that fg and bg can signal it as a job.
+ */
+void createProcess(char **args, int background) {
+    if (!hasJobSpace(1)) {
+        fprintf(stderr, "Error: too many jobs\n");
+        return;
+    }
+
+    pid_t processGroup = 0;
+    pid_t pid = spawnProcess(executablePath, args, STDIN_FILENO, STDOUT_FILENO, background ? &processGroup : NULL);
+
+    if (pid == -1)
+        return;
+
+    int job = addJob(processGroup, &pid, 1, !background);
+    if (background == 0) { //for foreground process
+        waitForJob(job);
+    } else { //for background process
+        printf("[%d] %d\n", job + 1, (int) pid);
+    }
+}
+
+/**
+ * This function is used to build the free lists of the job table.
+ *
+ * Every job and every process entry starts on its free list, in index order, so that the first job gets the number 1.
+ * Every bucket of the pid index starts empty.
+ */
+void initJobTable() {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        jobs[i].used = 0;
+        jobs[i].nextFree = i + 1 < MAX_JOBS ? i + 1 : -1;
+    }
+    for (int i = 0; i < MAX_JOB_PROCESSES; i++) {
+        jobProcesses[i].pid = 0;
+        jobProcesses[i].nextInBucket = i + 1 < MAX_JOB_PROCESSES ? i + 1 : -1;
+    }
+    for (int i = 0; i < JOB_HASH_SIZE; i++) {
+        jobProcessIndex[i] = -1;
+    }
+    freeJob = 0;
+    freeJobProcess = 0;
+    freeJobProcessCount = MAX_JOB_PROCESSES;
+    jobCount = 0;
+}
+
+/**
+ * This function is used to check if the job table can hold one more job.
+ *
+ * @param processCount The number of processes of the job.
+ * @return Returns 1 if a job and processCount process entries are free, 0 otherwise.
+ *
+ * It is called before the processes are started, so that a job that does not fit is never started.
+ */
+int hasJobSpace(int processCount) {
+    return freeJob != -1 && freeJobProcessCount >= processCount;
+}
+
+/**
+ * This function is used to add a job to the job table.
+ *
+ * @param processGroup The process group of the job, or 0 if its processes are in the process group of the shell.
+ * @param pids The pids of the processes of the job.
+ * @param processCount The number of processes of the job.
+ * @param foreground Equals 1 if the shell waits for the job with waitForJob, 0 if it runs in the background.
+ * @return Returns the index of the job in the jobs array. The number of the job, as used by fg and bg, is the index plus 1.
+ *
+ * The job is taken from the free list, and every process is taken from the free list of process entries and added
+ * to the bucket of its pid in jobProcessIndex, so that the job of a process is found in constant time when it changes state.
+ * A pidfd of every process is added to the epoll instance, and the process is reaped when its pidfd becomes readable.
+ * If pidfds are not supported, every process from then on is reaped when SIGCHLD arrives instead.
+ * The job records the command line in commandLine, the time it was started and, if the command line starts with the time
+ * builtin, that its resource use is to be printed once it is done. hasJobSpace must have been checked first.
+ */
+int addJob(pid_t processGroup, const pid_t *pids, int processCount, int foreground) {
+    int index = freeJob;
+    Job *job = &jobs[index];
+    freeJob = job->nextFree;
+
+    job->used = 1;
+    job->state = JOB_RUNNING;
+    job->foreground = foreground;
+    job->terminalGiven = 0;
+    job->notify = 0;
+    job->timed = timeCommand;
+    timeCommand = 0;
+    memset(&job->usage, 0, sizeof(job->usage));
+    job->processGroup = processGroup;
+    job->processCount = processCount;
+    job->lastPid = pids[processCount - 1];
+    job->status = 0;
+    job->firstProcess = -1;
+    clock_gettime(CLOCK_MONOTONIC, &job->startTime);
+    snprintf(job->command, sizeof(job->command), "%s", commandLine);
+
+    for (int i = 0; i < processCount; i++) {
+        int entry = freeJobProcess;
+        freeJobProcess = jobProcesses[entry].nextInBucket;
+        freeJobProcessCount--;
+
+        unsigned int bucket = (unsigned int) pids[i] & (JOB_HASH_SIZE - 1);
+        jobProcesses[entry].pid = pids[i];
+        jobProcesses[entry].job = index;
+        jobProcesses[entry].nextInBucket = jobProcessIndex[bucket];
+        jobProcessIndex[bucket] = entry;
+        jobProcesses[entry].nextInJob = job->firstProcess;
+        job->firstProcess = entry;
+
+        jobProcesses[entry].pidfd = -1;
+        if (pidfdSupported) {
+            int pidfd = (int) syscall(SYS_pidfd_open, pids[i], 0);
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = (uint64_t) (uint32_t) pids[i] << 32 | (uint32_t) entry;
+            if (pidfd != -1 && epoll_ctl(eventFd, EPOLL_CTL_ADD, pidfd, &event) == 0) {
+                jobProcesses[entry].pidfd = pidfd;
+            } else {
+                if (pidfd != -1)
+                    close(pidfd);
+                pidfdSupported = 0;
+            }
+        }
+    }
+    jobCount++;
+    return index;
+}
+
+/**
+ * This function is used to find the job of a process in the job table.
+ *
+ * @param pid The pid of the process.
+ * @return Returns the index of the job in the jobs array, or -1 if the process is not part of a job.
+ */
+int findJob(pid_t pid) {
+    int entry = jobProcessIndex[(unsigned int) pid & (JOB_HASH_SIZE - 1)];
+    while (entry != -1 && jobProcesses[entry].pid != pid) {
+        entry = jobProcesses[entry].nextInBucket;
+    }
+    return entry == -1 ? -1 : jobProcesses[entry].job;
+}
+
+/**
+ * This function is used to remove a process that terminated from its job.
+ *
+ * @param pid The pid of the process.
+ *
+ * The entry of the process is unlinked from its bucket and from the list of its job, its pidfd is removed from the epoll
+ * instance and closed, and the entry is put back on the free list. The job itself stays in the table until it is removed
+ * with removeJob.
+ */
+void removeJobProcess(pid_t pid) {
+    int *link = &jobProcessIndex[(unsigned int) pid & (JOB_HASH_SIZE - 1)];
+    while (*link != -1 && jobProcesses[*link].pid != pid) {
+        link = &jobProcesses[*link].nextInBucket;
+    }
+    if (*link == -1)
+        return;
+    int entry = *link;
+    *link = jobProcesses[entry].nextInBucket;
+
+    Job *job = &jobs[jobProcesses[entry].job];
+    link = &job->firstProcess;
+    while (*link != entry) {
+        link = &jobProcesses[*link].nextInJob;
+    }
+    *link = jobProcesses[entry].nextInJob;
+    job->processCount--;
+
+    // a builtin stage forked by runPipeline may hold a copy of the pidfd, which would keep it in the epoll instance
+    if (jobProcesses[entry].pidfd != -1) {
+        epoll_ctl(eventFd, EPOLL_CTL_DEL, jobProcesses[entry].pidfd, NULL);
+        close(jobProcesses[entry].pidfd);
+    }
+    jobProcesses[entry].pid = 0;
+    jobProcesses[entry].nextInBucket = freeJobProcess;
+    freeJobProcess = entry;
+    freeJobProcessCount++;
+}
+
+/**
+ * This function is used to remove a job from the job table.
+ *
+ * @param index The index of the job in the jobs array.
+ *
+ * The processes of the job that are still in the table are removed first, then the job is put back on the free list,
+ * so that its number is the next one given out.
+ */
+void removeJob(int index) {
+    Job *job = &jobs[index];
+    while (job->firstProcess != -1) {
+        removeJobProcess(jobProcesses[job->firstProcess].pid);
+    }
+    if (job->notify)
+        notifyCount--;
+    job->used = 0;
+    job->nextFree = freeJob;
+    freeJob = index;
+    jobCount--;
+}
+
+/**
+ * This function is used to send a signal to every process of a job.
+ *
+ * @param index The index of the job in the jobs array.
+ * @param signalNumber The signal to be sent.
+ *
+ * A job with a process group of its own is signalled with one call. The processes of a job that runs in the process group
+ * of the shell are signalled one by one, so that the shell is not signalled too.
+ */
+void signalJob(int index, int signalNumber) {
+    if (jobs[index].processGroup > 0) {
+        kill(-jobs[index].processGroup, signalNumber);
+        return;
+    }
+    for (int entry = jobs[index].firstProcess; entry != -1; entry = jobProcesses[entry].nextInJob) {
+        kill(jobProcesses[entry].pid, signalNumber);
+    }
+}
+
+/**
+ * This function is used to set up the epoll instance the main loop waits on.
+ *
+ * SIGCHLD, SIGTSTP and SIGINT are blocked and read from a signalfd instead of being handled asynchronously, so that
+ * they are handled by handleEvents at a well-defined point of the main loop. The signal mask the shell started with is
+ * kept in originalSignalMask and given back to every child. The signalfd and the standard input are added to
+ * the epoll instance; the standard input cannot be added if it is a regular file, in which case it is always
+ * considered readable. When the commands come from a script or the -c option, the standard input belongs to the commands
+ * and is not watched at all.
+ */
+void initEvents() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTSTP);
+    sigaddset(&mask, SIGINT);
+    if (sigprocmask(SIG_BLOCK, &mask, &originalSignalMask) == -1) {
+        perror("Error blocking signals");
+        exit(EXIT_FAILURE);
+    }
+    signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    eventFd = epoll_create1(EPOLL_CLOEXEC);
+    if (signalFd == -1 || eventFd == -1) {
+        perror("Error creating event loop");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = EVENT_SIGNALS;
+    if (epoll_ctl(eventFd, EPOLL_CTL_ADD, signalFd, &event) == -1) {
+        perror("Error creating event loop");
+        exit(EXIT_FAILURE);
+    }
+    event.data.u64 = EVENT_INPUT;
+    inputWatchable = interactive && epoll_ctl(eventFd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
+    inputWatched = inputWatchable;
+}
+
+/**
+ * This function is used to start or stop watching the standard input.
+ *
+ * @param enabled Equals 1 if the standard input is to be watched, 0 otherwise.
+ *
+ * The standard input is not watched while a foreground job runs, so that a line typed ahead does not wake the loop up
+ * until the job is done. It is removed from the epoll instance rather than given an empty event mask, since
+ * a hang-up would still be reported.
+ */
+void watchInput(int enabled) {
+    if (!inputWatchable || inputWatched == enabled)
+        return;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = EVENT_INPUT;
+    epoll_ctl(eventFd, enabled ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, STDIN_FILENO, &event);
+    inputWatched = enabled;
+}
+
+/**
+ * This function is used to wait for the events of the main loop and handle them.
+ *
+ * @param job The index of the foreground job to wait for, or -1 to wait for the standard input to be readable.
+ *
+ * Every event is handled in the order epoll reports it: the signals are handled by handleSignals, and a readable pidfd
+ * means its process terminated, so it is reaped with waitChild on the pidfd and the job table is updated by updateJob.
+ * Since every process is reaped through its own pidfd, the shell never reaps a child it is not looking for.
+ * The function returns once the foreground job has no process left, or once the standard input is readable.
+ */
+void handleEvents(int job) {
+    struct epoll_event events[MAX_EVENTS];
+
+    if (job == -1)
+        watchInput(1);
+    while (job == -1 || jobs[job].processCount > 0) {
+        // a regular file is always readable, and so is a line already in the buffer of the reader,
+        // so only the events that are already pending are handled
+        int inputBuffered = job == -1 && (!inputWatchable || hasBufferedLine(&inputReader));
+        int timeout = inputBuffered ? 0 : -1;
+        int count = epoll_wait(eventFd, events, MAX_EVENTS, timeout);
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Error waiting for events");
+            exit(EXIT_FAILURE);
+        }
+        int inputReady = 0;
+        for (int i = 0; i < count; i++) {
+            uint64_t data = events[i].data.u64;
+            if (data == EVENT_INPUT) {
+                inputReady = 1;
+            } else if (data == EVENT_SIGNALS) {
+                handleSignals();
+            } else {
+                int entry = (int) (uint32_t) data;
+                pid_t pid = (pid_t) (data >> 32);
+                // the entry may have been freed by an earlier event of the same batch
+                if (jobProcesses[entry].pid != pid)
+                    continue;
+                siginfo_t info;
+                struct rusage usage;
+                info.si_pid = 0;
+                if (waitChild(P_PIDFD, jobProcesses[entry].pidfd, &info, WEXITED | WNOHANG, &usage) == 0 &&
+                    info.si_pid != 0)
+                    updateJob(&info, &usage);
+            }
+        }
+        if (job == -1 && (inputReady || inputBuffered))
+            return;
+    }
+}
+
+/**
+ * This function is used to handle the signals read from the signalfd.
+ *
+ * SIGINT is passed on to the foreground job, and SIGTSTP (Ctrl+Z) kills it; both are ignored if no job runs in the
+ * foreground, so Ctrl+C at the prompt does nothing. A job without a process group of its own shares the group of the
+ * shell, so the terminal already sent it SIGINT, which is not passed on a second time. SIGCHLD means a child stopped or continued: every such change is collected with collectJobChanges, which
+ * leaves the terminated children to their pidfds. If pidfds are not supported, the terminated children are reaped there too.
+ */
+void handleSignals() {
+    struct signalfd_siginfo signals[16];
+    ssize_t length;
+    int childChanged = 0;
+
+    while ((length = read(signalFd, signals, sizeof(signals))) > 0) {
+        for (size_t i = 0; i < (size_t) length / sizeof(signals[0]); i++) {
+            if (signals[i].ssi_signo == SIGCHLD) {
+                childChanged = 1;
+            } else if (foregroundJob != -1 && signals[i].ssi_signo == SIGTSTP) {
+                signalJob(foregroundJob, SIGKILL);
+            } else if (foregroundJob != -1 && jobs[foregroundJob].processGroup > 0) {
+                signalJob(foregroundJob, SIGINT);
+            }
+        }
+    }
+    if (childChanged)
+        collectJobChanges(!pidfdSupported);
+}
+
+/**
+ * This function is used to collect the children that stopped or continued, after a SIGCHLD.
+ *
+ * @param exited Equals 1 if the children that terminated are reaped too, which is only done when pidfds are not supported.
+ *
+ * Every change is collected with waitid and given to updateJob.
+ */
+void collectJobChanges(int exited) {
+    int options = WSTOPPED | WCONTINUED | WNOHANG | (exited ? WEXITED : 0);
+    siginfo_t info;
+    struct rusage usage;
+    while (1) {
+        info.si_pid = 0;
+        if (waitChild(P_ALL, 0, &info, options, &usage) == -1 || info.si_pid == 0)
+            break;
+        updateJob(&info, &usage);
+    }
+}
+
+/**
+ * This function is used to record that a process of a job terminated, stopped or continued.
+ *
+ * @param info The state change of the process, as returned by waitChild.
+ * @param usage The resources used by the process, which are only meaningful if it terminated.
+ *
+ * A process of the foreground job that reads from the terminal is stopped with SIGTTIN. When that happens, and the shell
+ * owns the terminal, the terminal is given to the job and the job is continued. If the job is stopped for any other reason,
+ * such as Ctrl+Z after it got the terminal, it is killed, just as on a SIGTSTP sent to the shell.
+ * A background job that stops is marked as stopped. When the last process of a background job terminates, the job is
+ * marked as done; it stays in the table until reportJobs prints it before the next prompt.
+ * The resources used by every process that terminates are added to the ones of its job: the times and the context switches
+ * are summed, and the peak resident set size is the largest one of the processes. Once the last process terminates,
+ * the job is written to the accounting log.
+ */
+void updateJob(const siginfo_t *info, const struct rusage *usage) {
+    int index = findJob(info->si_pid);
+    if (index == -1)
+        return;
+    Job *job = &jobs[index];
+
+    if (info->si_code == CLD_STOPPED || info->si_code == CLD_TRAPPED) {
+        if (job->foreground) {
+            int ownsTerminal = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+            if ((info->si_status == SIGTTIN || info->si_status == SIGTTOU) && ownsTerminal &&
+                job->processGroup > 0 && !job->terminalGiven) {
+                setTerminalOwner(job->processGroup);
+                job->terminalGiven = 1;
+                signalJob(index, SIGCONT);
+            } else {
+                signalJob(index, SIGKILL);
+            }
+        } else if (job->state != JOB_STOPPED) {
+            job->state = JOB_STOPPED;
+            if (!job->notify)
+                notifyCount++;
+            job->notify = 1;
+        }
+    } else if (info->si_code == CLD_CONTINUED) {
+        if (job->state == JOB_STOPPED)
+            job->state = JOB_RUNNING;
+    } else {
+        // keep the status in the format of waitpid, so that it can be read with WIFEXITED and the like
+        if (info->si_pid == job->lastPid)
+            job->status = info->si_code == CLD_EXITED ? W_EXITCODE(info->si_status, 0) : info->si_status;
+        timeradd(&job->usage.ru_utime, &usage->ru_utime, &job->usage.ru_utime);
+        timeradd(&job->usage.ru_stime, &usage->ru_stime, &job->usage.ru_stime);
+        if (usage->ru_maxrss > job->usage.ru_maxrss)
+            job->usage.ru_maxrss = usage->ru_maxrss;
+        job->usage.ru_nvcsw += usage->ru_nvcsw;
+        job->usage.ru_nivcsw += usage->ru_nivcsw;
+        removeJobProcess(info->si_pid);
+        if (job->processCount == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &job->endTime);
+            logJob(index);
+        }
+        if (job->processCount == 0 && !job->foreground) {
+            job->state = JOB_DONE;
+            if (!job->notify)
+                notifyCount++;
+            job->notify = 1;
+        }
+    }
+}
+
+/**
+ * This function is used to print the background jobs that stopped or terminated since the last prompt.
+ *
+ * It is called by the main loop before every prompt, and prints the jobs in the order of their numbers. A job that is done
+ * is printed with its exit status, or with the signal that killed it, and removed from the job table.
+ */
+void reportJobs() {
+    for (int i = 0; i < MAX_JOBS && notifyCount > 0; i++) {
+        Job *job = &jobs[i];
+        if (!job->used || !job->notify)
+            continue;
+        job->notify = 0;
+        notifyCount--;
+        if (job->state == JOB_STOPPED) {
+            printf("[%d] Stopped\t%s\n", i + 1, job->command);
+            continue;
+        }
+        if (job->state != JOB_DONE)
+            continue;
+        if (WIFEXITED(job->status) && WEXITSTATUS(job->status) == 0)
+            printf("[%d] Done\t%s\n", i + 1, job->command);
+        else if (WIFEXITED(job->status))
+            printf("[%d] Exit %d\t%s\n", i + 1, WEXITSTATUS(job->status), job->command);
+        else
+            printf("[%d] %s\t%s\n", i + 1, strsignal(WTERMSIG(job->status)), job->command);
+        if (job->timed)
+            printUsage((double) (job->endTime.tv_sec - job->startTime.tv_sec) +
+                       (double) (job->endTime.tv_nsec - job->startTime.tv_nsec) / 1e9, &job->usage);
+        removeJob(i);
+    }
+}
+
+/**
+ * This function is used to collect the state change of a child along with its resource use.
+ *
+ * @param type, id, info, options The arguments of waitid.
+ * @param usage The resources used by the child, and by its children it waited for, are stored here if it terminated.
+ * @return Returns 0 on success, -1 on error.
+ *
+ * The waitid system call takes a struct rusage like wait4 does, but the glibc wrapper does not pass it,
+ * so the system call is made directly. Unlike wait4, it can wait on a pidfd.
+ */
+int waitChild(idtype_t type, id_t id, siginfo_t *info, int options, struct rusage *usage) {
+    memset(usage, 0, sizeof(*usage));
+    return (int) syscall(SYS_waitid, type, id, info, options, usage);
+}
+
+/**
+ * This function is used to print the time and resources used by a command, for the time builtin.
+ *
+ * @param seconds The wall-clock time of the command.
+ * @param usage The resources used by the command.
+ *
+ * The output goes to the standard output, since the standard error of the shell is redirected to stdError.txt.
+ */
+void printUsage(double seconds, const struct rusage *usage) {
+    printf("real\t%.3fs\n", seconds);
+    printf("user\t%.3fs\n", (double) usage->ru_utime.tv_sec + (double) usage->ru_utime.tv_usec / 1e6);
+    printf("sys\t%.3fs\n", (double) usage->ru_stime.tv_sec + (double) usage->ru_stime.tv_usec / 1e6);
+    printf("maxrss\t%ld KB\n", usage->ru_maxrss);
+    printf("ctxsw\t%ld voluntary, %ld involuntary\n", usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+/**
+ * This function is used to write the resource use of a job to the accounting log.
+ *
+ * @param index The index of the job in the jobs array, whose last process just terminated.
+ *
+ * The log is only written if MYSHELL_LOG names a file. Every job is written as one JSON object per line, with its command line,
+ * its process group, whether it ran in the background, its exit status (or the number of the signal that killed it),
+ * its wall-clock time, its user and system CPU time in seconds, its peak resident set size in kilobytes,
+ * and its voluntary and involuntary context switches. The line is written with a single write on a file opened with
+ * O_APPEND, so that the lines of several shells writing to the same log are never mixed.
+ */
+void logJob(int index) {
+    if (accountingLog == -1)
+        return;
+    Job *job = &jobs[index];
+
+    // the command line is written as a JSON string, with its quotes, backslashes and control characters escaped
+    char command[JOB_COMMAND_SIZE * 6 + 1];
+    size_t length = 0;
+    for (const unsigned char *c = (const unsigned char *) job->command; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            command[length++] = '\\';
+            command[length++] = (char) *c;
+        } else if (*c < 0x20) {
+            length += snprintf(command + length, sizeof(command) - length, "\\u%04x", *c);
+        } else {
+            command[length++] = (char) *c;
+        }
+    }
+    command[length] = '\0';
+
+    char line[JOB_COMMAND_SIZE * 6 + 512];
+    double seconds = (double) (job->endTime.tv_sec - job->startTime.tv_sec) +
+                     (double) (job->endTime.tv_nsec - job->startTime.tv_nsec) / 1e9;
+    int lineLength = snprintf(line, sizeof(line),
+                              "{\"command\":\"%s\",\"pgid\":%d,\"background\":%s,\"%s\":%d,\"real\":%.6f,"
+                              "\"user\":%.6f,\"sys\":%.6f,\"maxrss_kb\":%ld,\"voluntary_switches\":%ld,"
+                              "\"involuntary_switches\":%ld}\n",
+                              command, (int) job->processGroup, job->foreground ? "false" : "true",
+                              WIFEXITED(job->status) ? "exit" : "signal",
+                              WIFEXITED(job->status) ? WEXITSTATUS(job->status) : WTERMSIG(job->status), seconds,
+                              (double) job->usage.ru_utime.tv_sec + (double) job->usage.ru_utime.tv_usec / 1e6,
+                              (double) job->usage.ru_stime.tv_sec + (double) job->usage.ru_stime.tv_usec / 1e6,
+                              job->usage.ru_maxrss, job->usage.ru_nvcsw, job->usage.ru_nivcsw);
+    if (write(accountingLog, line, lineLength) == -1)
+        fprintf(stderr, "Error writing the accounting log\n");
+}
+
+/**
+ * This function is used to find the job given to the fg and bg builtins.
+ *
+ * @param args The command line arguments. The job is expected to be in args[1], as "%N" or "N", where N is the number
+ *             printed when the job was started. If args[1] is NULL, the job started last is used.
+ * @return Returns the index of the job in the jobs array, or -1 if there is no such job, in which case an error is printed.
+ */
+int findJobArgument(char **args) {
+    if (args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "Wrong usage of %s\n", args[0]);
+        return -1;
+    }
+    if (args[1] == NULL) {
+        int latest = -1;
+        for (int i = 0; i < MAX_JOBS; i++) {
+            if (jobs[i].used && (latest == -1 ||
+                                 jobs[i].startTime.tv_sec > jobs[latest].startTime.tv_sec ||
+                                 (jobs[i].startTime.tv_sec == jobs[latest].startTime.tv_sec &&
+                                  jobs[i].startTime.tv_nsec > jobs[latest].startTime.tv_nsec)))
+                latest = i;
+        }
+        if (latest == -1)
+            fprintf(stderr, "%s: no current job\n", args[0]);
+        return latest;
+    }
+    const char *number = args[1][0] == '%' ? args[1] + 1 : args[1];
+    char *end;
+    long index = strtol(number, &end, 10) - 1;
+    if (*number == '\0' || *end != '\0' || index < 0 || index >= MAX_JOBS || !jobs[index].used) {
+        fprintf(stderr, "%s: %s: no such job\n", args[0], args[1]);
+        return -1;
+    }
+    return (int) index;
+}
+
+/**
+ * This function is used to handle the jobs builtin, which lists the background jobs.
+ *
+ * @param args The command line arguments. No additional arguments are expected after the command itself.
+ *
+ * Every job is printed with its number, its process group, its state, the time since it was started and its command line.
+ */
+void jobsCommand(char **args) {
+    if (args[1] != NULL) {
+        fprintf(stderr, "Wrong usage of jobs\n");
+        return;
+    }
+    const char *states[] = {"Running", "Stopped", "Done"};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (int i = 0, found = 0; i < MAX_JOBS && found < jobCount; i++) {
+        if (!jobs[i].used)
+            continue;
+        found++;
+        double seconds = (double) (now.tv_sec - jobs[i].startTime.tv_sec) +
+                         (double) (now.tv_nsec - jobs[i].startTime.tv_nsec) / 1e9;
+        printf("[%d] %d %-8s %8.1fs  %s\n", i + 1, (int) jobs[i].processGroup, states[jobs[i].state], seconds,
+               jobs[i].command);
+    }
+}
+
+/**
+ * This function is used to handle the fg builtin, which brings a background job to the foreground.
+ *
+ * @param args The command line arguments. The job is given as in findJobArgument.
+ *
+ * The job is continued with SIGCONT and waited for with waitForJob, like any foreground job: it gets the terminal
+ * if it reads from it, and it is killed if it is stopped with Ctrl+Z.
+ */
+void fgCommand(char **args) {
+    int index = findJobArgument(args);
+    if (index == -1)
+        return;
+    printf("%s\n", jobs[index].command);
+    fflush(stdout);
+    jobs[index].state = JOB_RUNNING;
+    signalJob(index, SIGCONT);
+    waitForJob(index);
+}
+
+/**
+ * This function is used to handle the bg builtin, which continues a stopped background job.
+ *
+ * @param args The command line arguments. The job is given as in findJobArgument.
+ *
+ * The job is continued with SIGCONT and stays in the background. A job that reads from the terminal stops again.
+ */
+void bgCommand(char **args) {
+    int index = findJobArgument(args);
+    if (index == -1)
+        return;
+    Job *job = &jobs[index];
+    if (job->state != JOB_STOPPED) {
+        fprintf(stderr, "bg: job %d is already running\n", index + 1);
+        return;
+    }
+    signalJob(index, SIGCONT);
+    job->state = JOB_RUNNING;
+    printf("[%d] %s\n", index + 1, job->command);
+}
+
+/**
+ * This function is used to record the command line being run, so that the job table can show it.
+ *
+ * @param args The command line arguments, before they are cut by checkIO or runPipeline.
+ *
+ * The arguments are joined with spaces into commandLine, which is truncated if it is too long.
+ */
+void joinArguments(char **args) {
+    size_t length = 0;
+    commandLine[0] = '\0';
+    for (int i = 0; args[i] != NULL && length < sizeof(commandLine) - 1; i++) {
+        int written = snprintf(commandLine + length, sizeof(commandLine) - length, i == 0 ? "%s" : " %s", args[i]);
+        if (written < 0)
+            break;
+        length += (size_t) written;
+    }
+}
+
+/**
+ * This function checks if the given path is executable.
+ *
+ * @param path The path to the file to be checked.
+ * @return Returns 1 if the file is executable, 0 otherwise.
+ */
+int isExecutable(const char *path) {
+    return access(path, X_OK) == 0;
+}
+
+/**
+ * This function computes the FNV-1a hash of a command name.
+ *
+ * @param name The command name to be hashed.
+ * @return Returns the hash value of the name.
+ */
+unsigned int hashCommandName(const char *name) {
+    unsigned int hash = 2166136261u;
+    while (*name != '\0') {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * This function is used to clear the PATH resolution cache.
+ *
+ * It frees every cached entry, forgets the saved PATH value and the saved directory modification times,
+ * so that the next lookup rebuilds the cache from the current PATH.
+ */
+void clearPathCache() {
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+        PathCacheEntry *entry = pathCache[i];
+        while (entry != NULL) {
+            PathCacheEntry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+        pathCache[i] = NULL;
+    }
+    for (int i = 0; i < pathDirectoryCount; i++) {
+        free(pathDirectories[i].name);
+    }
+    free(pathDirectories);
+    pathDirectories = NULL;
+    pathDirectoryCount = 0;
+    free(cachedPathValue);
+    cachedPathValue = NULL;
+}
+
+/**
+ * This function is used to split the PATH environment variable into the list of directories that are searched.
+ *
+ * @param pathValue The value of the PATH environment variable.
+ *
+ * The function stores every directory of PATH along with its modification time, so that a later change
+ * in one of the directories (an executable added or removed) can be detected with a single stat call.
+ * An empty PATH entry means the current directory, as in the shell.
+ */
+void loadPathDirectories(const char *pathValue) {
+    cachedPathValue = strdup(pathValue);
+    if (cachedPathValue == NULL) {
+        fprintf(stderr, "Error duplicating string for PATH\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *start = pathValue;
+    while (1) {
+        const char *end = strchr(start, ':');
+        size_t length = end == NULL ? strlen(start) : (size_t) (end - start);
+
+        pathDirectories = realloc(pathDirectories, (pathDirectoryCount + 1) * sizeof(PathDirectory));
+        if (pathDirectories == NULL) {
+            fprintf(stderr, "Error reallocating memory for PATH directories\n");
+            exit(EXIT_FAILURE);
+        }
+        PathDirectory *directory = &pathDirectories[pathDirectoryCount++];
+        directory->name = length == 0 ? strdup(".") : strndup(start, length);
+        if (directory->name == NULL) {
+            fprintf(stderr, "Error duplicating string for PATH\n");
+            exit(EXIT_FAILURE);
+        }
+        struct stat st;
+        directory->modificationTime = stat(directory->name, &st) == 0 ? st.st_mtim : (struct timespec) {0, 0};
+
+        if (end == NULL)
+            break;
+        start = end + 1;
+    }
+}
+
+/**
+ * This function checks if a directory of PATH changed since the cache was filled.
+ *
+ * @param index The index of the directory in the pathDirectories array.
+ * @return Returns 1 if the modification time of the directory changed, 0 otherwise.
+ */
+int pathDirectoryChanged(int index) {
+    struct stat st;
+    struct timespec modificationTime = stat(pathDirectories[index].name, &st) == 0 ? st.st_mtim : (struct timespec) {0, 0};
+    return modificationTime.tv_sec != pathDirectories[index].modificationTime.tv_sec ||
+           modificationTime.tv_nsec != pathDirectories[index].modificationTime.tv_nsec;
+}
+
+/**
+ * This function finds the executable path of a given executable file.
+ *
+ * @param executable The name of the executable file.
+ *
+ * If the name contains a slash, it is used as the path as it is, like the shell does.
+ * Otherwise the function first looks for the name in the PATH resolution cache. A cached path is only used if PATH did not change
+ * and none of the directories up to the one holding the executable changed, because a new file in an earlier directory would
+ * take precedence and a removed file would make the cached path wrong. If any of them changed, the whole cache is cleared.
+ * On a cache miss, the function walks the directories of PATH in order and takes the first regular file that is executable,
+ * then stores the result in the cache. The result is copied to the global variable executablePath. If the executable
+ * cannot be found, executablePath is left unchanged.
+ */
+void findExecutablePath(const char *executable) {
+    if (strchr(executable, '/') != NULL) {
+        snprintf(executablePath, sizeof(executablePath), "%s", executable);
+        return;
+    }
+
+    const char *pathValue = getenv("PATH");
+    if (pathValue == NULL)
+        pathValue = "";
+    if (cachedPathValue == NULL || strcmp(cachedPathValue, pathValue) != 0) {
+        clearPathCache();
+        loadPathDirectories(pathValue);
+    }
+
+    unsigned int hash = hashCommandName(executable);
+    PathCacheEntry *entry = pathCache[hash % PATH_CACHE_SIZE];
+    while (entry != NULL && strcmp(entry->name, executable) != 0) {
+        entry = entry->next;
+    }
+    if (entry != NULL) {
+        int changed = 0;
+        for (int i = 0; i <= entry->directoryIndex && !changed; i++) {
+            changed = pathDirectoryChanged(i);
+        }
+        if (!changed) {
+            pathCacheHits++;
+            strcpy(executablePath, entry->path);
+            return;
+        }
+        clearPathCache();
+        loadPathDirectories(pathValue);
+    }
+
+    pathCacheMisses++;
+    for (int i = 0; i < pathDirectoryCount; i++) {
+        snprintf(path, sizeof(path), "%s/%s", pathDirectories[i].name, executable);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && isExecutable(path)) {
+            entry = malloc(sizeof(PathCacheEntry) + strlen(executable) + 1);
+            if (entry == NULL) {
+                fprintf(stderr, "Error allocating memory for PATH cache\n");
+                exit(EXIT_FAILURE);
+            }
+            strcpy(entry->name, executable);
+            strcpy(entry->path, path);
+            entry->directoryIndex = i;
+            entry->next = pathCache[hash % PATH_CACHE_SIZE];
+            pathCache[hash % PATH_CACHE_SIZE] = entry;
+            strcpy(executablePath, path);
+            return;
+        }
+    }
+}
+
+/**
+ * This function is used to handle the hash builtin, which manages the PATH resolution cache.
+ *
+ * @param args The command line arguments. "hash -r" clears the cache, "hash" alone prints the cached commands
+ *             along with the number of cache hits and misses.
+ */
+void hashCommand(char **args) {
+    if (args[1] != NULL && !strcmp(args[1], "-r") && args[2] == NULL) {
+        clearPathCache();
+        return;
+    }
+    if (args[1] != NULL) {
+        fprintf(stderr, "Wrong usage of hash\n");
+        return;
+    }
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+        for (PathCacheEntry *entry = pathCache[i]; entry != NULL; entry = entry->next) {
+            printf("%s\t%s\n", entry->name, entry->path);
+        }
+    }
+    printf("hits: %lu misses: %lu\n", pathCacheHits, pathCacheMisses);
+}
+
+/**
+ * This function is used to fill the builtin table.
+ *
+ * Every builtin is placed in the slot given by hashBuiltinName. The hash function was chosen so that no two builtin names
+ * share a slot, which makes the table a perfect hash: a lookup computes one hash and compares one name. If a builtin
+ * added later collides with another one, the shell stops here rather than hiding a builtin.
+ */
+void initBuiltins() {
+    for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+        unsigned int slot = hashBuiltinName(builtins[i].name, strlen(builtins[i].name));
+        if (builtinTable[slot] != NULL) {
+            fprintf(stderr, "Builtins %s and %s have the same hash\n", builtinTable[slot]->name, builtins[i].name);
+            exit(EXIT_FAILURE);
+        }
+        builtinTable[slot] = &builtins[i];
+    }
+}
+
+/**
+ * This function computes the slot of a builtin name in the builtin table.
+ *
+ * @param name The command name.
+ * @param length The length of the name, at least 1.
+ * @return Returns the slot of the name, from 0 to BUILTIN_TABLE_SIZE - 1.
+ */
+unsigned int hashBuiltinName(const char *name, size_t length) {
+    return ((unsigned char) name[0] + (unsigned char) name[length - 1] * 9u + (unsigned int) length) &
+           (BUILTIN_TABLE_SIZE - 1);
+}
+
+/**
+ * This function is used to find a builtin command.
+ *
+ * @param name The command name.
+ * @return Returns the builtin, or NULL if the name is not a builtin.
+ */
+const Builtin *findBuiltin(const char *name) {
+    size_t length = strlen(name);
+    if (length == 0)
+        return NULL;
+    const Builtin *builtin = builtinTable[hashBuiltinName(name, length)];
+    return builtin != NULL && strcmp(builtin->name, name) == 0 ? builtin : NULL;
+}
+
+/**
+ * This function is used to run a builtin command in the shell process, with the input/output redirection recorded by checkIO.
+ *
+ * @param builtin The builtin to be run.
+ * @param args The command line arguments, already cut at the redirection operator by checkIO.
+ *
+ * The redirected file descriptor is saved with a duplicate, the file is put in its place with applyRedirection,
+ * and the saved descriptor is put back once the builtin returns, so "echo x > f" starts no process at all.
+ * The standard output is flushed before and after the builtin, so that its output goes to the right file.
+ * The exit status of the builtin is stored in lastStatus.
+ */
+void runBuiltinCommand(const Builtin *builtin, char **args) {
+    int target = -1, savedFd = -1;
+    if (input || output || append || standardError) {
+        if ((input == 1 && inputFile == NULL) || (input == 0 && outputFile == NULL)) {
+            fprintf(stderr, "Error: missing file name for redirection\n");
+            lastStatus = W_EXITCODE(1, 0);
+            return;
+        }
+        target = input ? STDIN_FILENO : standardError ? STDERR_FILENO : STDOUT_FILENO;
+        fflush(stdout);
+        savedFd = fcntl(target, F_DUPFD_CLOEXEC, 10);
+        if (savedFd == -1 || applyRedirection() == -1) {
+            fprintf(stderr, "Error redirecting input/output\n");
+            if (savedFd != -1)
+                close(savedFd);
+            lastStatus = W_EXITCODE(1, 0);
+            return;
+        }
+    }
+
+    lastStatus = 0;
+    builtin->function(args);
+
+    if (target != -1) {
+        fflush(stdout);
+        dup2(savedFd, target);
+        close(savedFd);
+    }
+}
+
+/**
+ * This function is used to handle the cd builtin, which changes the current directory of the shell.
+ *
+ * @param args The command line arguments. The directory is expected to be in args[1]. If it is missing, the directory is HOME,
+ *             and if it is "-", the directory is the previous one, which is printed.
+ *
+ * PWD and OLDPWD are updated. If PATH has a relative directory, the PATH cache is cleared, since the directory now means
+ * another one.
+ */
+void cdCommand(char **args) {
+    if (args[1] != NULL && args[2] != NULL) {
+        fprintf(stderr, "Wrong usage of cd\n");
+        lastStatus = W_EXITCODE(1, 0);
+        return;
+    }
+    const char *directory = args[1] == NULL ? getenv("HOME") : !strcmp(args[1], "-") ? getenv("OLDPWD") : args[1];
+    if (directory == NULL) {
+        fprintf(stderr, "cd: %s not set\n", args[1] == NULL ? "HOME" : "OLDPWD");
+        lastStatus = W_EXITCODE(1, 0);
+        return;
+    }
+    char *previous = getcwd(NULL, 0);
+    if (chdir(directory) == -1) {
+        fprintf(stderr, "cd: %s: %s\n", directory, strerror(errno));
+        free(previous);
+        lastStatus = W_EXITCODE(1, 0);
+        return;
+    }
+    char *current = getcwd(NULL, 0);
+    if (previous != NULL)
+        setenv("OLDPWD", previous, 1);
+    if (current != NULL)
+        setenv("PWD", current, 1);
+    if (args[1] != NULL && !strcmp(args[1], "-") && current != NULL)
+        printf("%s\n", current);
+    free(previous);
+    free(current);
+
+    for (int i = 0; i < pathDirectoryCount; i++) {
+        if (pathDirectories[i].name[0] != '/') {
+            clearPathCache();
+            break;
+        }
+    }
+}
+
+/**
+ * This function is used to handle the echo builtin.
+ *
+ * @param args The command line arguments. The arguments from args[1] onwards are printed, separated by spaces.
+ *             If args[1] is "-n", it is skipped and no newline is printed at the end.
+ */
+void echoCommand(char **args) {
+    int index = 1, newline = 1;
+    if (args[1] != NULL && !strcmp(args[1], "-n")) {
+        newline = 0;
+        index = 2;
+    }
+    for (int first = index; args[index] != NULL; index++) {
+        if (index > first)
+            putchar(' ');
+        fputs(args[index], stdout);
+    }
+    if (newline)
+        putchar('\n');
+}
+
+/**
+ * This function is used to handle the pwd builtin, which prints the current directory.
+ *
+ * @param args The command line arguments. No additional arguments are expected after the command itself.
+ */
+void pwdCommand(char **args) {
+    if (args[1] != NULL) {
+        fprintf(stderr, "Wrong usage of pwd\n");
+        lastStatus = W_EXITCODE(1, 0);
+        return;
+    }
+    char *current = getcwd(NULL, 0);
+    if (current == NULL) {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        lastStatus = W_EXITCODE(1, 0);
+        return;
+    }
+    printf("%s\n", current);
+    free(current);
+}
+
+/**
+ * This function is used to evaluate the expression of the test builtin.
+ *
+ * @param args The arguments of the expression.
+ * @param count The number of arguments.
+ * @return Returns 0 if the expression is true, 1 if it is false, 2 if it is not valid.
+ *
+ * The expression is "! EXPRESSION", "STRING", a unary file or string test ("-e", "-f", "-d", "-r", "-w", "-x", "-s", "-n", "-z")
+ * followed by its operand, or a binary string ("=", "!=") or integer ("-eq", "-ne", "-lt", "-le", "-gt", "-ge") comparison.
+ */
+int evaluateTest(char **args, int count) {
+    if (count > 0 && !strcmp(args[0], "!")) {
+        int result = evaluateTest(args + 1, count - 1);
+        return result == 2 ? 2 : !result;
+    }
+    if (count == 0)
+        return 1;
+    if (count == 1)
+        return args[0][0] == '\0';
+    if (count == 2) {
+        const char *operator = args[0], *operand = args[1];
+        struct stat st;
+        if (!strcmp(operator, "-n"))
+            return operand[0] == '\0';
+        if (!strcmp(operator, "-z"))
+            return operand[0] != '\0';
+        if (!strcmp(operator, "-r"))
+            return access(operand, R_OK) != 0;
+        if (!strcmp(operator, "-w"))
+            return access(operand, W_OK) != 0;
+        if (!strcmp(operator, "-x"))
+            return access(operand, X_OK) != 0;
+        if (strcmp(operator, "-e") != 0 && strcmp(operator, "-f") != 0 && strcmp(operator, "-d") != 0 &&
+            strcmp(operator, "-s") != 0) {
+            fprintf(stderr, "test: %s: unary operator expected\n", operator);
+            return 2;
+        }
+        if (stat(operand, &st) == -1)
+            return 1;
+        if (!strcmp(operator, "-f"))
+            return !S_ISREG(st.st_mode);
+        if (!strcmp(operator, "-d"))
+            return !S_ISDIR(st.st_mode);
+        if (!strcmp(operator, "-s"))
+            return st.st_size == 0;
+        return 0;
+    }
+    if (count == 3) {
+        const char *operator = args[1];
+        if (!strcmp(operator, "="))
+            return strcmp(args[0], args[2]) != 0;
+        if (!strcmp(operator, "!="))
+            return strcmp(args[0], args[2]) == 0;
+        const char *operators[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        int which = -1;
+        for (int i = 0; i < 6; i++) {
+            if (!strcmp(operator, operators[i]))
+                which = i;
+        }
+        if (which == -1) {
+            fprintf(stderr, "test: %s: binary operator expected\n", operator);
+            return 2;
         }
-    } else if (pid < 0) {
-        fprintf(stderr, "Error forking process\n");
+        char *end1, *end2;
+        long first = strtol(args[0], &end1, 10), second = strtol(args[2], &end2, 10);
+        if (args[0][0] == '\0' || *end1 != '\0' || args[2][0] == '\0' || *end2 != '\0') {
+            fprintf(stderr, "test: integer expression expected\n");
+            return 2;
+        }
+        int results[] = {first == second, first != second, first < second, first <= second, first > second,
+                         first >= second};
+        return !results[which];
     }
+    fprintf(stderr, "test: too many arguments\n");
+    return 2;
 }
 
 /**
- * This function is used to create a new process.
+ * This function is used to handle the test builtin, and its "[" form.
  *
- * @param args The command line arguments.
- * @param background Equals 1 if the process is to be run in the background, 0 otherwise.
+ * @param args The command line arguments. The expression is given from args[1] onwards, as in evaluateTest.
+ *             With "[", the last argument must be "]".
  *
- * The function first forks the current process. If the fork fails, it prints an error message and terminates the program.
- * If the fork succeeds, it checks if the current process is the child process or the parent process.
- * If it is the child process, it executes the command using the execv function.
- * If the execv function fails, it prints an error message and terminates the program.
- * If it is the parent process, it checks if the process is to be run in the background.
- * If it is not, it waits for the child process to terminate.
- * If it is, it adds the pid of the child process to the array of background processes.
+ * The exit status is 0 if the expression is true, 1 if it is false, and 2 if it is not valid.
  */
-void createProcess(char **args, int background) {
-    pid_t pid = fork();
-
-    if (pid == -1) {
-        fprintf(stderr, "Error forking process\n");
-        exit(EXIT_FAILURE);
-    } else if (pid == 0) {
-        // Child process
-        execv(executablePath, args);
-        fprintf(stderr, "Error executing command\n");
-        exit(EXIT_FAILURE);
-    } else {
-        // Parent process
-        if (background == 0) { //for foreground process
-            int status;
-            foregroundProcess = pid;
-            wait(NULL);
-        } else { //for background process
-            backgroundProcessCount++;
-            backgroundProcesses = realloc(backgroundProcesses, backgroundProcessCount * sizeof(pid_t));
-            if (backgroundProcesses == NULL) {
-                fprintf(stderr, "Error reallocating memory for background processes\n");
-                exit(EXIT_FAILURE);
-            }
-            backgroundProcesses[backgroundProcessCount - 1] = pid;
+void testCommand(char **args) {
+    int count = 0;
+    while (args[count + 1] != NULL)
+        count++;
+    if (!strcmp(args[0], "[")) {
+        if (count == 0 || strcmp(args[count], "]") != 0) {
+            fprintf(stderr, "[: missing ]\n");
+            lastStatus = W_EXITCODE(2, 0);
+            return;
         }
+        count--;
     }
+    lastStatus = W_EXITCODE(evaluateTest(args + 1, count), 0);
 }
 
 /**
- * This function is used to remove a process from the array of background processes.
- *
- * @param pid The pid of the process to be removed.
- *
- * The function loops through the array of background processes and checks if the given pid matches any of the pids in the array.
- * If it does, it shifts all subsequent elements to the left, reallocates memory for the array, and decreases the background process count by 1.
+ * This function is used to handle the true builtin, which does nothing successfully.
  */
-void removeProcess(pid_t pid) {
-    int i;
-    for (i = 0; i < backgroundProcessCount; i++) {
-        if (backgroundProcesses[i] == pid) {
-            // Shift all subsequent elements to the left
-            memmove(&backgroundProcesses[i], &backgroundProcesses[i + 1],
-                    (backgroundProcessCount - i - 1) * sizeof(pid_t));
-            backgroundProcessCount--;
-
-            // Reallocate memory for the array
-            backgroundProcesses = realloc(backgroundProcesses, backgroundProcessCount * sizeof(pid_t));
-            if (backgroundProcesses == NULL && backgroundProcessCount > 0) {
-                fprintf(stderr, "Error reallocating memory for background processes\n");
-                exit(EXIT_FAILURE);
-            }
-            break;
-        }
-    }
+void trueCommand(char **args) {
+    (void) args;
 }
 
 /**
- * This function checks if the given path is executable.
- *
- * @param path The path to the file to be checked.
- * @return Returns 1 if the file is executable, 0 otherwise.
+ * This function is used to handle the false builtin, which does nothing unsuccessfully.
  */
-int isExecutable(const char *path) {
-    return access(path, X_OK) == 0;
+void falseCommand(char **args) {
+    (void) args;
+    lastStatus = W_EXITCODE(1, 0);
 }
 
 /**
- * This function finds the executable path of a given executable file.
+ * This function is used to handle the exit builtin.
  *
- * @param executable The name of the executable file.
+ * @param args The command line arguments. The exit status may be given in args[1], 0 by default.
  *
- * The function first constructs a command "which <executable>" to find the path of the executable.
- * Then it opens a pipe to execute the command and read its output.
- * If the pipe cannot be opened, it prints an error message and returns.
- * It reads the output of the command line by line and copies each line to the global variable executablePath.
- * After reading all the output, it closes the pipe and removes the trailing newline character from executablePath.
+ * The shell does not exit while it has background jobs.
  */
-void findExecutablePath(const char *executable) {
-    char command[256];
-    sprintf(command, "which %s", executable);
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Error executing command\n");
+void exitCommand(char **args) {
+    if (jobCount > 0) {
+        printf("There are background processes running. Please terminate them first.\n");
+        lastStatus = W_EXITCODE(1, 0);
         return;
     }
-    while (fgets(path, sizeof(path) - 1, fp) != NULL) {
-        strcpy(executablePath, path);
-    }
-    pclose(fp);
-    executablePath[strcspn(executablePath, "\n")] = '\0';
+    fflush(stdout);
+    exit(args[1] != NULL ? atoi(args[1]) : 0);
 }
 
 /**
@@ -524,32 +4080,267 @@ int checkIO(char **args) {
 }
 
 /**
- * This function is used to handle the SIGTSTP signal (Ctrl+Z).
+ * This function is used to find the path of the bookmark file.
  *
- * If there is a foreground process running, it sends the SIGKILL signal to terminate it and sets the foregroundProcess to 0.
+ * The bookmark file is MYSHELL_BOOKMARKS, or ~/.myshell_bookmarks, and holds one bookmark per line. It is not read here:
+ * loadBookmarks reads it when a bookmark command first needs it. If there is no bookmark file yet, it is created when the
+ * first bookmark is added.
  */
-void sigtstpHandler() {
-    if (foregroundProcess > 0) {
-        kill(-foregroundProcess, SIGKILL);
-        foregroundProcess = 0;
+void findBookmarkFile() {
+    const char *file = getenv("MYSHELL_BOOKMARKS");
+    const char *home = getenv("HOME");
+    if (file != NULL && file[0] != '\0') {
+        bookmarkPath = strdup(file);
+    } else if (home != NULL && home[0] != '\0') {
+        bookmarkPath = malloc(strlen(home) + sizeof("/.myshell_bookmarks"));
+        if (bookmarkPath != NULL)
+            sprintf(bookmarkPath, "%s/.myshell_bookmarks", home);
     }
 }
 
 /**
- * This function is used to handle the SIGCHLD signal, which is sent to a process when a child process terminates.
+ * This function is used to lock the bookmark file against the other shells that change it.
  *
- * It repeatedly calls waitpid with a pid of -1 and the WNOHANG option, which causes it to return immediately if no child processes have exited.
- * If a child process has exited, it gets its pid and checks if it exited normally using the WIFEXITED macro.
- * If it did, it calls the removeProcess function to remove the pid from the array of background processes.
+ * The lock is taken on a ".lock" file next to the bookmark file, since the bookmark file itself is replaced by saveBookmarks.
+ * Adding a bookmark holds it for its append, and deleting one holds it from reading the file to renaming the new one, so
+ * a bookmark another shell appends in between is not lost. Closing the returned descriptor releases the lock.
+ *
+ * @return Returns the descriptor of the lock file, or -1 on error.
  */
-void sigchldHandler() {
-    int status;
-    pid_t pid;
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        if (WIFEXITED(status)) {
-            removeProcess(pid);  // Remove the process ID from the array
+int lockBookmarkFile() {
+    size_t pathLength = strlen(bookmarkPath);
+    char *lockPath = malloc(pathLength + sizeof(".lock"));
+    if (lockPath == NULL)
+        return -1;
+    sprintf(lockPath, "%s.lock", bookmarkPath);
+    int fd = open(lockPath, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    free(lockPath);
+    if (fd == -1)
+        return -1;
+    while (flock(fd, LOCK_EX) == -1) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * This function is used to copy the bookmark file into memory.
+ *
+ * The file is copied rather than mapped: another shell, or an editor, may truncate it, which would make a mapping
+ * raise SIGBUS. A missing file reads as an empty one.
+ *
+ * @param size Set to the size of the copy.
+ * @return Returns the copy, which the caller frees, or NULL on error.
+ */
+char *readBookmarkFile(size_t *size) {
+    size_t capacity = 4096, length = 0;
+    char *text = malloc(capacity);
+    if (text == NULL)
+        return NULL;
+    int fd = open(bookmarkPath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        *size = 0;
+        if (errno == ENOENT)
+            return text;
+        free(text);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= capacity)
+        capacity = st.st_size + 1;
+    while (1) {
+        if (length == capacity) {
+            char *larger = realloc(text, capacity * 2);
+            if (larger == NULL)
+                break;
+            text = larger;
+            capacity *= 2;
+        }
+        ssize_t count = read(fd, text + length, capacity - length);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            close(fd);
+            if (count == 0) {
+                *size = length;
+                return text;
+            }
+            free(text);
+            return NULL;
+        }
+        length += count;
+    }
+    close(fd);
+    free(text);
+    return NULL;
+}
+
+/**
+ * This function is used to replace the bookmarks array with the lines of a copy of the bookmark file.
+ *
+ * Every line becomes a bookmark that points into the copy, so nothing is copied again: a bookmark is split into arguments
+ * only when it is first executed. The previous bookmarks and the previous copy are freed, so no bookmark may be running.
+ *
+ * @param text The copy of the bookmark file, which the bookmarks array takes over.
+ * @param size The size of the copy.
+ */
+void setBookmarks(char *text, size_t size) {
+    for (int i = 0; i < bookmarkCount; i++) {
+        freeBookmark(&bookmarks[i]);
+    }
+    bookmarkCount = 0;
+    free(bookmarkText);
+    bookmarkText = text;
+    bookmarkTextSize = size;
+    const char *start = text, *end = text + size;
+    while (start < end) {
+        const char *newline = memchr(start, '\n', end - start);
+        size_t length = (newline == NULL ? end : newline) - start;
+        if (length > 0)
+            appendBookmark(start, length, NULL);
+        start += length + 1;
+    }
+}
+
+/**
+ * This function is used to read the bookmarks of the bookmark file.
+ *
+ * It is called by every bookmark command, and only does something the first time.
+ */
+void loadBookmarks() {
+    if (bookmarksLoaded)
+        return;
+    bookmarksLoaded = 1;
+    if (bookmarkPath == NULL)
+        return;
+    size_t size;
+    char *text = readBookmarkFile(&size);
+    if (text == NULL) {
+        fprintf(stderr, "Error reading bookmark file %s\n", bookmarkPath);
+        return;
+    }
+    setBookmarks(text, size);
+}
+
+/**
+ * This function is used to add a bookmark at the end of the bookmarks array.
+ *
+ * @param command The command line of the bookmark, which does not have to be null-terminated.
+ * @param length The length of the command line.
+ * @param allocated The null-terminated copy of the command line the bookmark owns, or NULL if the command line is in the
+ *                  copy of the bookmark file.
+ */
+void appendBookmark(const char *command, size_t length, char *allocated) {
+    if (bookmarkCount == bookmarkCapacity) {
+        bookmarkCapacity = bookmarkCapacity == 0 ? 16 : bookmarkCapacity * 2;
+        bookmarks = realloc(bookmarks, bookmarkCapacity * sizeof(Bookmark));
+        if (bookmarks == NULL) {
+            fprintf(stderr, "Error reallocating memory for bookmarks\n");
+            exit(EXIT_FAILURE);
         }
     }
+    Bookmark *bookmark = &bookmarks[bookmarkCount++];
+    bookmark->command = command;
+    bookmark->length = length;
+    bookmark->args = NULL;
+    bookmark->shellSyntax = 0;
+    bookmark->allocated = allocated;
+    bookmark->running = 0;
+}
+
+/**
+ * This function is used to rewrite the bookmark file.
+ *
+ * The text is written to a temporary file, which is synced and renamed over the bookmark file, so the file is never
+ * left half written. The caller holds the lock of lockBookmarkFile.
+ *
+ * @param text The new contents of the bookmark file.
+ * @param size The size of the new contents.
+ * @return Returns 0 on success, -1 on error.
+ */
+int saveBookmarks(const char *text, size_t size) {
+    size_t pathLength = strlen(bookmarkPath);
+    char *temporaryPath = malloc(pathLength + sizeof(".tmp"));
+    if (temporaryPath == NULL)
+        return -1;
+    sprintf(temporaryPath, "%s.tmp", bookmarkPath);
+
+    FILE *file = fopen(temporaryPath, "w");
+    int result = file == NULL ? -1 : 0;
+    if (file != NULL && size > 0 && fwrite(text, 1, size, file) != size)
+        result = -1;
+    if (file != NULL && (fflush(file) != 0 || fsync(fileno(file)) != 0))
+        result = -1;
+    if (file != NULL && fclose(file) != 0)
+        result = -1;
+    if (result == 0 && rename(temporaryPath, bookmarkPath) == -1)
+        result = -1;
+    if (result == -1) {
+        fprintf(stderr, "Error writing bookmark file %s\n", bookmarkPath);
+        unlink(temporaryPath);
+    }
+    free(temporaryPath);
+    return result;
+}
+
+/**
+ * This function is used to split a bookmark into the arguments it is executed with.
+ *
+ * @param bookmark The bookmark.
+ *
+ * The command line is copied right after the argument array, in the same allocation, and split at blanks, as setup does.
+ * If the command line uses shell syntax, such as quotes, pipes, redirection, variables, globs or a leading assignment,
+ * it is not split; it is marked to be run by sh instead.
+ */
+void tokenizeBookmark(Bookmark *bookmark) {
+    int count = 0;
+    for (size_t i = 0; i < bookmark->length; i++) {
+        char c = bookmark->command[i];
+        if (strchr("|&;<>()$`\\\"'*?[]{}~#", c) != NULL)
+            bookmark->shellSyntax = 1;
+        if (c == '=' && count <= 1)
+            bookmark->shellSyntax = 1; // "NAME=value command"
+        if ((c != ' ' && c != '\t') && (i == 0 || bookmark->command[i - 1] == ' ' || bookmark->command[i - 1] == '\t'))
+            count++;
+    }
+    if (count == 0)
+        bookmark->shellSyntax = 1;
+
+    // sh -c <command>, or the arguments, followed by the copy of the command line
+    int slots = bookmark->shellSyntax ? 4 : count + 1;
+    bookmark->args = malloc(slots * sizeof(char *) + bookmark->length + 1);
+    if (bookmark->args == NULL) {
+        fprintf(stderr, "Error allocating memory for bookmark\n");
+        exit(EXIT_FAILURE);
+    }
+    char *text = (char *) (bookmark->args + slots);
+    memcpy(text, bookmark->command, bookmark->length);
+    text[bookmark->length] = '\0';
+    if (bookmark->shellSyntax) {
+        bookmark->args[0] = "sh";
+        bookmark->args[1] = "-c";
+        bookmark->args[2] = text;
+        bookmark->args[3] = NULL;
+        return;
+    }
+    int index = 0;
+    for (char *argument = strtok(text, " \t"); argument != NULL; argument = strtok(NULL, " \t")) {
+        bookmark->args[index++] = argument;
+    }
+    bookmark->args[index] = NULL;
+}
+
+/**
+ * This function is used to free a bookmark.
+ *
+ * @param bookmark The bookmark.
+ */
+void freeBookmark(Bookmark *bookmark) {
+    free(bookmark->args);
+    free(bookmark->allocated);
 }
 
 /**
@@ -561,7 +4352,8 @@ void sigchldHandler() {
  *             are expected to be in args[2] and onwards.
  *
  * The function first checks if args[1] is not NULL. If it is, it prints an error message and returns.
- * Then it checks the value of args[1] to determine the operation to be performed:
+ * Then it reads the bookmark file with loadBookmarks, if it was not read yet, and checks the value of args[1]
+ * to determine the operation to be performed:
  *     - If args[1] is "-d", it calls the deleteBookmark function with args as the argument.
  *     - If args[1] is "-l", it calls the listBookmark function with args as the argument.
  *     - If args[1] is "-i", it calls the executeBookmark function with args as the argument.
@@ -572,6 +4364,7 @@ void bookmark(char **args) {
         fprintf(stderr, "Wrong usage of bookmark\n");
         return;
     }
+    loadBookmarks();
     if (!strcmp(args[1], "-d")) {
         deleteBookmark(args);
     } else if (!strcmp(args[1], "-l")) {
@@ -591,9 +4384,12 @@ void bookmark(char **args) {
  *
  * The function first checks if args[1] and args[2] are not NULL and args[3] is NULL. If not, it prints an error message and returns.
  * Then it converts args[2] to an integer and checks if the index is within the range of the bookmarks array.
- * If it is, it frees the memory allocated for the bookmark at the given index, shifts all subsequent bookmarks to the left,
- * reallocates the bookmarks array to decrease its size by 1, and decreases the bookmark count by 1.
+ * If it is, it locks the bookmark file and reads it again, since other shells may have added or deleted bookmarks
+ * since it was loaded. It removes the line of the bookmark from what it read, at the same index if it is still there and
+ * otherwise its first copy, rewrites the bookmark file with the rest, and makes that the bookmarks array.
  * If the index is not within the range of the bookmarks array, it prints an error message.
+ * A bookmark cannot be deleted by a bookmark that is running, since that would free the arguments being executed and
+ * move the bookmarks that are running to other indexes.
  */
 void deleteBookmark(char **args) {
     if (args[1] == NULL || args[2] == NULL || args[3] != NULL) {
@@ -605,11 +4401,55 @@ void deleteBookmark(char **args) {
         fprintf(stderr, "Wrong usage of bookmark\n");
         return;
     }
-    free(bookmarks[index]);
-    // Shift all subsequent elements to the left
-    memmove(&bookmarks[index], &bookmarks[index + 1], (bookmarkCount - index - 1) * sizeof(char *));
-    bookmarks = realloc(bookmarks, (bookmarkCount - 1) * sizeof(char *));
-    bookmarkCount--;
+    if (runningBookmarks > 0) {
+        fprintf(stderr, "Error: a bookmark cannot be deleted while a bookmark is running\n");
+        return;
+    }
+    if (bookmarkPath == NULL) {
+        freeBookmark(&bookmarks[index]);
+        // Shift all subsequent elements to the left
+        memmove(&bookmarks[index], &bookmarks[index + 1], (bookmarkCount - index - 1) * sizeof(Bookmark));
+        bookmarkCount--;
+        return;
+    }
+    int lockFd = lockBookmarkFile();
+    size_t size;
+    char *text = lockFd == -1 ? NULL : readBookmarkFile(&size);
+    if (text == NULL) {
+        fprintf(stderr, "Error reading bookmark file %s\n", bookmarkPath);
+        if (lockFd != -1)
+            close(lockFd);
+        return;
+    }
+
+    const Bookmark *deleted = &bookmarks[index];
+    char *line = NULL, *start = text, *end = text + size;
+    int lineIndex = 0;
+    while (start < end) {
+        char *newline = memchr(start, '\n', end - start);
+        size_t length = (newline == NULL ? end : newline) - start;
+        if (length == deleted->length && !memcmp(start, deleted->command, length)) {
+            if (line == NULL || lineIndex == index)
+                line = start;
+            if (lineIndex >= index)
+                break;
+        }
+        if (length > 0)
+            lineIndex++;
+        start += length + 1;
+    }
+    if (line != NULL) {
+        size_t lineSize = deleted->length + (line + deleted->length < end);
+        memmove(line, line + lineSize, end - line - lineSize);
+        size -= lineSize;
+        if (saveBookmarks(text, size) == -1) {
+            free(text);
+            close(lockFd);
+            return;
+        }
+    }
+    close(lockFd);
+    setBookmarks(text, size);
 }
 
 /**
@@ -627,33 +4467,427 @@ void listBookmark(char **args) {
         return;
     }
     for (int i = 0; i < bookmarkCount; i++) {
-        printf("%d \"%s\"\n", i, bookmarks[i]);
+        printf("%d \"%.*s\"\n", i, (int) bookmarks[i].length, bookmarks[i].command);
     }
 }
 
 /**
- * This function is used to execute a bookmark from the bookmarks array.
+ * This function is used to execute a bookmark, or a set of bookmarks, from the bookmarks array.
  *
- * @param args The command line arguments. The index of the bookmark to be executed is expected to be in args[2].
- *             For example, if the bookmark at index 0 is to be executed, args[2] will be "0".
+ * @param args The command line arguments. The bookmarks to be executed are expected to be in args[2], either as one index
+ *             or as a set of indexes and ranges read by parseBookmarkSet. For example, "bookmark -i 0" executes the
+ *             bookmark at index 0, and "bookmark -i 0-15 -j 8" executes the bookmarks 0 to 15 with at most 8 of them
+ *             running at the same time. The options that can follow the set are:
+ *                 -j N: Runs at most N bookmarks at the same time. It is 1 by default.
+ *                 -f: Stops at the first bookmark that fails: the bookmarks still running are terminated and the ones
+ *                     not started yet are skipped. By default every bookmark is run, whatever the others do.
  *
- * The function first checks if args[1] and args[2] are not NULL and args[3] is NULL. If not, it prints an error message and returns.
- * Then it converts args[2] to an integer and checks if the index is within the range of the bookmarks array.
- * If it is, it executes the bookmark at the given index using the system function.
- * If the index is not within the range of the bookmarks array, it prints an error message.
+ * A single index without options executes the bookmark with runBookmark, so that it runs in the foreground with the
+ * terminal. Otherwise the bookmarks are executed with runBookmarks. If the arguments are not valid, or an index is not
+ * within the range of the bookmarks array, it prints an error message.
  */
 void executeBookmark(char **args) {
-    if (args[1] == NULL || args[2] == NULL || args[3] != NULL) {
+    if (args[1] == NULL || args[2] == NULL) {
         fprintf(stderr, "Wrong usage of bookmark\n");
         return;
     }
-    int index = atoi(args[2]);
+    int jobLimit = 1, failFast = 0, parallel = 0;
+    for (int i = 3; args[i] != NULL; i++) {
+        char *end;
+        if (!strcmp(args[i], "-j") && args[i + 1] != NULL) {
+            long value = strtol(args[++i], &end, 10);
+            if (*end != '\0' || value < 1 || value > MAX_JOB_PROCESSES) {
+                fprintf(stderr, "Wrong usage of bookmark\n");
+                return;
+            }
+            jobLimit = (int) value;
+        } else if (!strcmp(args[i], "-f")) {
+            failFast = 1;
+        } else {
+            fprintf(stderr, "Wrong usage of bookmark\n");
+            return;
+        }
+        parallel = 1;
+    }
+
+    int count;
+    int *indexes = parseBookmarkSet(args[2], &count);
+    if (indexes == NULL)
+        return;
+    if (count == 1 && !parallel)
+        runBookmark(indexes[0]);
+    else
+        runBookmarks(indexes, count, jobLimit, failFast);
+    free(indexes);
+}
+
+/**
+ * This function is used to run a bookmark in the foreground.
+ *
+ * @param index The index of the bookmark in the bookmarks array.
+ *
+ * The bookmark is split into arguments the first time it is run. A bookmark that names a builtin is run by the shell itself,
+ * and any other one is started with spawnProcess, like a command typed at the prompt, so no sh is started unless the
+ * bookmark uses shell syntax. In the shell process, the bookmark is a job that is waited for with waitForJob. In a forked
+ * pipeline stage, which does not own the event loop, the process is waited for with waitpid. The exit status is stored
+ * in lastStatus. The redirection of the bookmark command itself was already performed by runBuiltinCommand or by the
+ * pipeline, so the process just inherits it.
+ * A bookmark that is already running, because it runs itself through the bookmark builtin directly or through other
+ * bookmarks, is not run again, since the shell would recurse until its stack overflows. The flag is read by index once
+ * the bookmark is done, since a bookmark added by the bookmark may move the bookmarks array.
+ */
+void runBookmark(int index) {
+    Bookmark *bookmark = &bookmarks[index];
+    if (bookmark->running) {
+        fprintf(stderr, "Error: bookmark %d is already running\n", index);
+        lastStatus = W_EXITCODE(1, 0);
+        return;
+    }
+    if (bookmark->args == NULL)
+        tokenizeBookmark(bookmark);
+    bookmark->running = 1;
+    runningBookmarks++;
 
-    if (index >= 0 && index < bookmarkCount) {
-        system(bookmarks[index]);
+    const Builtin *builtin = bookmark->shellSyntax ? NULL : findBuiltin(bookmark->args[0]);
+    int savedInput = input, savedOutput = output, savedAppend = append, savedStandardError = standardError;
+    input = output = append = standardError = 0;
+    if (builtin != NULL) {
+        lastStatus = 0;
+        builtin->function(bookmark->args);
     } else {
-        fprintf(stderr, "Wrong usage of bookmark\n");
+        executablePath[0] = '\0';
+        findExecutablePath(bookmark->shellSyntax ? "/bin/sh" : bookmark->args[0]);
+        if (!isExecutable(executablePath)) {
+            fprintf(stderr, "Error: %s is not executable\n", bookmark->args[0]);
+            lastStatus = W_EXITCODE(127, 0);
+        } else if (eventFd == -1) {
+            pid_t pid = spawnProcess(executablePath, bookmark->args, STDIN_FILENO, STDOUT_FILENO, NULL);
+            int status = W_EXITCODE(127, 0);
+            if (pid > 0)
+                while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+            lastStatus = status;
+        } else if (!hasJobSpace(1)) {
+            fprintf(stderr, "Error: too many jobs\n");
+        } else {
+            pid_t pid = spawnProcess(executablePath, bookmark->args, STDIN_FILENO, STDOUT_FILENO, NULL);
+            if (pid > 0) {
+                snprintf(commandLine, sizeof(commandLine), "%.*s", (int) bookmark->length, bookmark->command);
+                waitForJob(addJob(0, &pid, 1, 1));
+            }
+        }
+    }
+    input = savedInput;
+    output = savedOutput;
+    append = savedAppend;
+    standardError = savedStandardError;
+    bookmarks[index].running = 0;
+    runningBookmarks--;
+}
+
+/**
+ * This function is used to read the set of bookmarks given to "bookmark -i".
+ *
+ * @param text The set, as a comma-separated list of indexes and ranges, such as "3", "0-15" or "0-3,7,9-10".
+ * @param count The number of bookmarks in the set is stored here.
+ * @return Returns the indexes of the bookmarks in the set, in the given order, or NULL if the set is not valid,
+ *         in which case an error is printed. The array must be freed by the caller.
+ */
+int *parseBookmarkSet(const char *text, int *count) {
+    int *indexes = NULL;
+    int capacity = 0;
+    *count = 0;
+    const char *position = text;
+    while (1) {
+        char *end;
+        long first = strtol(position, &end, 10), last = first;
+        int valid = end != position && isdigit((unsigned char) *position);
+        if (valid && *end == '-') {
+            position = end + 1;
+            last = strtol(position, &end, 10);
+            valid = end != position && isdigit((unsigned char) *position);
+        }
+        if (!valid || (*end != ',' && *end != '\0') || first > last || first < 0 || last >= bookmarkCount) {
+            fprintf(stderr, "Wrong usage of bookmark\n");
+            free(indexes);
+            return NULL;
+        }
+        for (long index = first; index <= last; index++) {
+            if (*count == capacity) {
+                capacity = capacity == 0 ? 16 : capacity * 2;
+                indexes = realloc(indexes, capacity * sizeof(int));
+                if (indexes == NULL) {
+                    fprintf(stderr, "Error reallocating memory for bookmarks\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            indexes[(*count)++] = (int) index;
+        }
+        if (*end == '\0')
+            return indexes;
+        position = end + 1;
+    }
+}
+
+/**
+ * This function is used to start one bookmark of "bookmark -i" with its standard output going to a pipe.
+ *
+ * @param run The run of the bookmark.
+ * @param nullFd A descriptor of /dev/null, which is the standard input of the bookmark.
+ * @return Returns 0 on success, -1 if the bookmark could not be started, in which case its status is set to 127.
+ *
+ * A bookmark that names a builtin is run in a forked child of the shell, like a builtin pipeline stage, and any other one
+ * is started with spawnProcess. The standard input is /dev/null, so that the bookmarks running at the same time do not
+ * compete for the terminal. Every bookmark runs in a process group of its own, whose id is its pid, so that the processes
+ * it starts, such as the ones of sh, are signalled along with it. A pidfd of the process is opened, so that runBookmarks
+ * can wait for it with poll. A bookmark that is already running, as in runBookmark, is not started, and the forked child
+ * marks its bookmark as running, so that a bookmark cannot start itself from the child either.
+ */
+int startBookmarkRun(BookmarkRun *run, int nullFd) {
+    Bookmark *bookmark = &bookmarks[run->bookmark];
+    clock_gettime(CLOCK_MONOTONIC, &run->startTime);
+    run->status = W_EXITCODE(127, 0);
+    run->pidfd = run->outputFd = -1;
+    if (bookmark->running) {
+        fprintf(stderr, "Error: bookmark %d is already running\n", run->bookmark);
+        run->status = W_EXITCODE(1, 0);
+        return -1;
+    }
+    if (bookmark->args == NULL)
+        tokenizeBookmark(bookmark);
+
+    const Builtin *builtin = bookmark->shellSyntax ? NULL : findBuiltin(bookmark->args[0]);
+    executablePath[0] = '\0';
+    if (builtin == NULL)
+        findExecutablePath(bookmark->shellSyntax ? "/bin/sh" : bookmark->args[0]);
+    if (builtin != NULL ? !builtin->pipeline : !isExecutable(executablePath)) {
+        fprintf(stderr, "Error: %s cannot be run\n", bookmark->args[0]);
+        return -1;
+    }
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        fprintf(stderr, "Error creating pipe\n");
+        return -1;
+    }
+
+    if (builtin != NULL) {
+        fflush(stdout); // the child must not inherit the output of the shell that is not written yet
+        run->pid = fork();
+        if (run->pid == 0) {
+            setpgid(0, 0);
+            sigprocmask(SIG_SETMASK, &originalSignalMask, NULL);
+            if (eventFd != -1) {
+                // the epoll instance is shared with the shell, so the child must not change it
+                close(eventFd);
+                close(signalFd);
+                eventFd = signalFd = -1;
+            }
+            if (dup2(nullFd, STDIN_FILENO) == -1 || dup2(pipeFds[1], STDOUT_FILENO) == -1)
+                _exit(EXIT_FAILURE);
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+            lastStatus = 0;
+            bookmark->running = 1;
+            runningBookmarks++;
+            builtin->function(bookmark->args);
+            fflush(stdout);
+            _exit(WEXITSTATUS(lastStatus));
+        }
+        if (run->pid > 0)
+            setpgid(run->pid, run->pid); // from both sides, so the group is in place whichever of the two runs first
+    } else {
+        pid_t processGroup = 0;
+        run->pid = spawnProcess(executablePath, bookmark->args, nullFd, pipeFds[1], &processGroup);
+    }
+    close(pipeFds[1]);
+    if (run->pid <= 0) {
+        close(pipeFds[0]);
+        return -1;
+    }
+    run->outputFd = pipeFds[0];
+    run->pidfd = (int) syscall(SYS_pidfd_open, run->pid, 0);
+    run->running = 1;
+    return 0;
+}
+
+/**
+ * This function is used to run a set of bookmarks, with at most a given number of them running at the same time.
+ *
+ * @param indexes The indexes of the bookmarks, in the order they are started and printed.
+ * @param count The number of bookmarks.
+ * @param jobLimit The largest number of bookmarks that run at the same time.
+ * @param failFast Equals 1 if the bookmarks still running are terminated, and the ones not started yet are skipped,
+ *                 once a bookmark fails. Otherwise every bookmark is run whatever the others do.
+ *
+ * The standard output of every bookmark goes to a pipe of its own, and is kept in a buffer of its own, so the outputs of
+ * the bookmarks never interleave: the output of a bookmark is printed once it and all the bookmarks before it are done,
+ * so the output is in the order of the set, whatever the order the bookmarks finish in. The shell waits with poll on the
+ * pipes and on a pidfd of every running bookmark, and reaps each bookmark through its own pidfd, so it never reaps a job
+ * of the job table. Without pidfds, a bookmark is reaped with waitpid once its output is closed. The bookmarks are
+ * terminated by signalling their process groups, so that the processes they started do not keep their pipes open.
+ * Since the bookmarks are not in the foreground process group, the shell also waits on its signalfd, if it has one:
+ * SIGINT is passed on to every running bookmark and SIGTSTP kills them, as for a foreground job, and the background
+ * jobs that stopped or continued are collected with collectJobChanges.
+ *
+ * Once every bookmark is done, the exit status and duration of each one are printed. lastStatus is set to the status
+ * of the first bookmark of the set that failed, or to 0.
+ */
+void runBookmarks(const int *indexes, int count, int jobLimit, int failFast) {
+    BookmarkRun *runs = calloc(count, sizeof(BookmarkRun));
+    struct pollfd *pollFds = malloc((2 * (size_t) (jobLimit < count ? jobLimit : count) + 1) * sizeof(struct pollfd));
+    BookmarkRun **polled = malloc((2 * (size_t) (jobLimit < count ? jobLimit : count) + 1) * sizeof(BookmarkRun *));
+    int nullFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (runs == NULL || pollFds == NULL || polled == NULL || nullFd == -1) {
+        fprintf(stderr, "Error starting bookmarks\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int next = 0, running = 0, printed = 0, failed = 0, stopped = 0;
+    while (printed < count) {
+        while (next < count && running < jobLimit && !(failFast && failed)) {
+            BookmarkRun *run = &runs[next++];
+            run->bookmark = indexes[next - 1];
+            if (startBookmarkRun(run, nullFd) == 0) {
+                running++;
+            } else {
+                clock_gettime(CLOCK_MONOTONIC, &run->endTime);
+                run->done = 1;
+                failed = 1;
+            }
+        }
+        if (failFast && failed && !stopped) {
+            for (int i = 0; i < next; i++) {
+                if (runs[i].running)
+                    kill(-runs[i].pid, SIGTERM);
+            }
+            for (; next < count; next++) {
+                runs[next].bookmark = indexes[next];
+                runs[next].skipped = runs[next].done = 1;
+            }
+            stopped = 1;
+        }
+
+        // the outputs are printed in the order of the set, as soon as every bookmark before them is done
+        while (printed < count && runs[printed].done) {
+            fwrite(runs[printed].output, 1, runs[printed].outputLength, stdout);
+            free(runs[printed].output);
+            runs[printed].output = NULL;
+            printed++;
+        }
+        if (running == 0)
+            continue;
+
+        int pollCount = 0;
+        for (int i = 0; i < next; i++) {
+            if (!runs[i].running)
+                continue;
+            if (runs[i].outputFd != -1) {
+                pollFds[pollCount] = (struct pollfd) {runs[i].outputFd, POLLIN, 0};
+                polled[pollCount++] = &runs[i];
+            }
+            if (runs[i].pidfd != -1 && !runs[i].exited) {
+                pollFds[pollCount] = (struct pollfd) {runs[i].pidfd, POLLIN, 0};
+                polled[pollCount++] = &runs[i];
+            }
+        }
+        if (signalFd != -1) {
+            pollFds[pollCount] = (struct pollfd) {signalFd, POLLIN, 0};
+            polled[pollCount++] = NULL;
+        }
+        if (poll(pollFds, pollCount, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Error waiting for bookmarks");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < pollCount; i++) {
+            BookmarkRun *run = polled[i];
+            if (pollFds[i].revents == 0)
+                continue;
+            if (run == NULL) {
+                struct signalfd_siginfo signals[16];
+                ssize_t length;
+                int childChanged = 0;
+                while ((length = read(signalFd, signals, sizeof(signals))) > 0) {
+                    for (size_t j = 0; j < (size_t) length / sizeof(signals[0]); j++) {
+                        if (signals[j].ssi_signo == SIGCHLD) {
+                            childChanged = 1;
+                            continue;
+                        }
+                        for (int k = 0; k < next; k++) {
+                            if (runs[k].running)
+                                kill(-runs[k].pid, signals[j].ssi_signo == SIGTSTP ? SIGKILL : SIGINT);
+                        }
+                    }
+                }
+                // the bookmarks are reaped here, so the terminated children are left to their pidfds or to waitpid
+                if (childChanged)
+                    collectJobChanges(0);
+                continue;
+            }
+            if (pollFds[i].fd == run->outputFd) {
+                if (run->outputLength == run->outputCapacity) {
+                    run->outputCapacity = run->outputCapacity == 0 ? 4096 : run->outputCapacity * 2;
+                    run->output = realloc(run->output, run->outputCapacity);
+                    if (run->output == NULL) {
+                        fprintf(stderr, "Error reallocating memory for bookmark output\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                ssize_t length = read(run->outputFd, run->output + run->outputLength,
+                                      run->outputCapacity - run->outputLength);
+                if (length > 0) {
+                    run->outputLength += length;
+                } else if (length == 0 || errno != EINTR) {
+                    close(run->outputFd);
+                    run->outputFd = -1;
+                    if (run->pidfd == -1) {
+                        while (waitpid(run->pid, &run->status, 0) == -1 && errno == EINTR);
+                        run->exited = 1;
+                    }
+                }
+            } else {
+                siginfo_t info;
+                struct rusage usage;
+                info.si_pid = 0;
+                if (waitChild(P_PIDFD, run->pidfd, &info, WEXITED | WNOHANG, &usage) == 0 && info.si_pid != 0) {
+                    run->status = info.si_code == CLD_EXITED ? W_EXITCODE(info.si_status, 0) : info.si_status;
+                    run->exited = 1;
+                }
+            }
+
+            if (run->running && run->exited && run->outputFd == -1) {
+                clock_gettime(CLOCK_MONOTONIC, &run->endTime);
+                if (run->pidfd != -1)
+                    close(run->pidfd);
+                run->running = 0;
+                run->done = 1;
+                running--;
+                if (run->status != 0)
+                    failed = 1;
+            }
+        }
+    }
+    fflush(stdout);
+
+    lastStatus = 0;
+    for (int i = 0; i < count; i++) {
+        BookmarkRun *run = &runs[i];
+        double seconds = (double) (run->endTime.tv_sec - run->startTime.tv_sec) +
+                         (double) (run->endTime.tv_nsec - run->startTime.tv_nsec) / 1e9;
+        if (run->skipped)
+            printf("bookmark %d: skipped\n", run->bookmark);
+        else if (WIFEXITED(run->status))
+            printf("bookmark %d: exit %d, %.3f s\n", run->bookmark, WEXITSTATUS(run->status), seconds);
+        else
+            printf("bookmark %d: %s, %.3f s\n", run->bookmark, strsignal(WTERMSIG(run->status)), seconds);
+        if (lastStatus == 0 && !run->skipped && run->status != 0)
+            lastStatus = run->status;
     }
+    close(nullFd);
+    free(polled);
+    free(pollFds);
+    free(runs);
 }
 
 /**
@@ -663,57 +4897,112 @@ void executeBookmark(char **args) {
  *             The bookmark should start with a double quote (") and end with a double quote (").
  *             For example, if the bookmark is "ls -l", args[1] will be "\"ls" and args[2] will be "-l\"".
  *
- * The function first reallocates the bookmarks array to increase its size by 1.
- * Then it checks if the first character of args[1] and the last character of the last argument are double quotes.
- * If they are, it concatenates all the arguments from args[1] to the last argument into a single string,
+ * The function checks if the first character of args[1] and the last character of the last argument are double quotes.
+ * If they are, it joins all the arguments from args[1] to the last argument into a single string,
  * removes the double quotes from the start and end of the string, and adds the string to the bookmarks array.
+ * The bookmark is split into arguments right away, and appended to the bookmark file with a single write, under the lock
+ * of lockBookmarkFile.
  * If the first character of args[1] and the last character of the last argument are not double quotes,
  * it prints an error message and returns.
  *
- * If any error occurs during the execution of the function (such as failing to reallocate memory for the bookmarks array
- * or failing to duplicate the string for the bookmark), the function prints an error message and terminates the program.
+ * If any error occurs during the execution of the function (such as failing to allocate memory for the bookmark),
+ * the function prints an error message and terminates the program.
  */
 void addBookmark(char **args) {
-    bookmarks = realloc(bookmarks, (bookmarkCount + 1) * sizeof(char *));
-    if (bookmarks == NULL) {
-        fprintf(stderr, "Error reallocating memory for bookmarks");
-        exit(EXIT_FAILURE);
+    int last = 1;
+    size_t length = 0;
+    for (int i = 1; args[i] != NULL; i++) {
+        length += strlen(args[i]) + 1;
+        last = i;
     }
+    size_t lastLength = strlen(args[last]);
 
     // args[1] starts with " and the last argument ends with "
-    if (args[1][0] == '"' && args[numberOfArguments - 1][strlen(args[numberOfArguments - 1]) - 1] == '"') {
-        char command[256];
-        command[0] = '\0';  // Initialize an empty string
-        int i = 1;
-        while (args[i] != NULL) {
-            strcat(command, args[i]);
-            if (args[i + 1] != NULL)
-                strcat(command, " ");
-            i++;
-        }
-        if (strlen(command) < 3) {
+    if (args[1][0] == '"' && lastLength > 0 && args[last][lastLength - 1] == '"') {
+        char *command = malloc(length + 1);
+        if (command == NULL) {
+            fprintf(stderr, "Error allocating memory for bookmark\n");
+            exit(EXIT_FAILURE);
+        }
+        command[0] = '\0';
+        size_t position = 0;
+        for (int i = 1; args[i] != NULL; i++) {
+            position += sprintf(command + position, i == 1 ? "%s" : " %s", args[i]);
+        }
+        if (position < 3) {
             fprintf(stderr, "Wrong usage of bookmark\n");
+            free(command);
             return;
         }
         // Remove double quotes
-        memmove(command, command + 1, strlen(command));
-        command[strlen(command) - 1] = '\0';
+        memmove(command, command + 1, position);
+        command[position - 2] = '\0';
+        length = position - 2;
 
-        bookmarks[bookmarkCount] = strdup(command);
-        if (bookmarks[bookmarkCount] == NULL) {
-            fprintf(stderr, "Error duplicating string for bookmark");
-            exit(EXIT_FAILURE);
+        appendBookmark(command, length, command);
+        tokenizeBookmark(&bookmarks[bookmarkCount - 1]);
+
+        if (bookmarkPath != NULL) {
+            int lockFd = lockBookmarkFile();
+            int fd = lockFd == -1 ? -1 : open(bookmarkPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+            command[length] = '\n';
+            if (fd == -1 || write(fd, command, length + 1) != (ssize_t) (length + 1))
+                fprintf(stderr, "Error writing bookmark file %s\n", bookmarkPath);
+            command[length] = '\0';
+            if (fd != -1)
+                close(fd);
+            if (lockFd != -1)
+                close(lockFd);
         }
-        bookmarkCount++;
     } else {
         fprintf(stderr, "Wrong usage of bookmark\n");
     }
 }
 
-int main(void) {
-    char inputBuffer[MAX_LINE];   /*buffer to hold command entered */
+int main(int argc, char *argv[]) {
     int background;               /* equals 1 if a command is followed by '&' */
-    char *args[MAX_LINE / 2 + 1]; /*command line arguments */
+    char **args;                  /*command line arguments */
+    struct timespec timeStart;    /* start of a builtin run with the time builtin */
+    struct rusage timeUsage;      /* resources used by the shell and its children before the builtin */
+    int timedBuiltin = 0;         /* equals 1 if the last command was a builtin run with the time builtin */
+
+    // MYSHELL_SPAWN=fork selects the fork and execv fallback
+    const char *backend = getenv("MYSHELL_SPAWN");
+    if (backend != NULL && !strcmp(backend, "fork"))
+        spawnBackend = SPAWN_FORK;
+
+    // myshell --bench-spawn <count> [megabytes]
+    if (argc >= 3 && !strcmp(argv[1], "--bench-spawn")) {
+        return benchmarkSpawn(atoi(argv[2]), argc >= 4 ? atoi(argv[3]) : 0) == 0 ? 0 : 1;
+    }
+
+    // myshell --bench-search <directory> <string>
+    if (argc == 4 && !strcmp(argv[1], "--bench-search")) {
+        benchmarkSearch(argv[2], argv[3]);
+        return 0;
+    }
+
+    // myshell -c <commands> runs the commands, myshell <script> runs the commands of the file, both without prompting
+    if (argc == 3 && !strcmp(argv[1], "-c")) {
+        inputReader.fd = -1;
+        inputReader.length = strlen(argv[2]);
+        inputReader.capacity = inputReader.length + 1;
+        inputReader.buffer = malloc(inputReader.capacity);
+        if (inputReader.buffer == NULL) {
+            fprintf(stderr, "Error allocating memory for the command line\n");
+            return -1;
+        }
+        memcpy(inputReader.buffer, argv[2], inputReader.length);
+        interactive = 0;
+    } else if (argc == 2 && argv[1][0] != '-') {
+        inputReader.fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (inputReader.fd == -1) {
+            fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+            return 127;
+        }
+        interactive = 0;
+    }
+
     FILE *errorFile = fopen("stdError.txt", "w");
     if (errorFile == NULL) {
         fprintf(stderr, "Error opening file\n");
@@ -725,35 +5014,94 @@ int main(void) {
         exit(EXIT_FAILURE);
     }
 
-    signal(SIGTSTP, sigtstpHandler);
-    signal(SIGCHLD, sigchldHandler);
+    memset(&timeStart, 0, sizeof(timeStart));
+    memset(&timeUsage, 0, sizeof(timeUsage));
+
+    // MYSHELL_LOG=<file> writes the resource use of every job to <file>
+    const char *logPath = getenv("MYSHELL_LOG");
+    if (logPath != NULL && logPath[0] != '\0') {
+        accountingLog = open(logPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+        if (accountingLog == -1)
+            perror("Error opening the accounting log");
+    }
+
+    initJobTable();
+    initEvents();
+    initBuiltins();
+    findBookmarkFile();
 
     while (1) {
         background = 0;
-        printf("myshell: ");
-        fflush(0);
+        if (timedBuiltin) {
+            // the time builtin ran a builtin, which started no job: the resources used by the shell and by the children
+            // it reaped meanwhile are printed
+            struct timespec now;
+            struct rusage self, children, usage;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            getrusage(RUSAGE_SELF, &self);
+            getrusage(RUSAGE_CHILDREN, &children);
+            timeradd(&self.ru_utime, &children.ru_utime, &usage.ru_utime);
+            timeradd(&self.ru_stime, &children.ru_stime, &usage.ru_stime);
+            timersub(&usage.ru_utime, &timeUsage.ru_utime, &usage.ru_utime);
+            timersub(&usage.ru_stime, &timeUsage.ru_stime, &usage.ru_stime);
+            usage.ru_maxrss = self.ru_maxrss > children.ru_maxrss ? self.ru_maxrss : children.ru_maxrss;
+            usage.ru_nvcsw = self.ru_nvcsw + children.ru_nvcsw - timeUsage.ru_nvcsw;
+            usage.ru_nivcsw = self.ru_nivcsw + children.ru_nivcsw - timeUsage.ru_nivcsw;
+            printUsage((double) (now.tv_sec - timeStart.tv_sec) + (double) (now.tv_nsec - timeStart.tv_nsec) / 1e9,
+                       &usage);
+            timedBuiltin = 0;
+        }
+        // a timed command that started no job, because it failed, must not time the next one
+        timeCommand = 0;
+        reportJobs();
+        if (interactive) {
+            printf("myshell: ");
+            fflush(0);
+        }
+        handleEvents(-1);
         /*setup() calls exit() when Control-D is entered */
-        setup(inputBuffer, args, &background);
+        setup(&inputReader, &args, &background);
 
         if (args[0] == NULL)
             continue; // If enter pressed without any command
 
+        // "time <command>" runs the command and prints the time and resources it used
+        if (!strcmp(args[0], "time") && args[1] != NULL && strcmp(args[1], "&") != 0) {
+            for (int i = 0; args[i] != NULL; i++)
+                args[i] = args[i + 1];
+            numberOfArguments--;
+            timeCommand = 1;
+            struct rusage self, children;
+            clock_gettime(CLOCK_MONOTONIC, &timeStart);
+            getrusage(RUSAGE_SELF, &self);
+            getrusage(RUSAGE_CHILDREN, &children);
+            timeradd(&self.ru_utime, &children.ru_utime, &timeUsage.ru_utime);
+            timeradd(&self.ru_stime, &children.ru_stime, &timeUsage.ru_stime);
+            timeUsage.ru_nvcsw = self.ru_nvcsw + children.ru_nvcsw;
+            timeUsage.ru_nivcsw = self.ru_nivcsw + children.ru_nivcsw;
+        }
+        joinArguments(args);
+
+        if (isPipeline(args)) {
+            runPipeline(args, background);
+            continue;
+        }
+
+        int redirected = checkIO(args);
+        const Builtin *builtin = findBuiltin(args[0]);
+        if (builtin != NULL) {
+            // a builtin always runs in the shell process, in the foreground
+            if (!redirected && strcmp(args[numberOfArguments - 1], "&") == 0)
+                args[numberOfArguments - 1] = NULL;
+            runBuiltinCommand(builtin, args);
+            timedBuiltin = timeCommand; // cleared by addJob if the builtin started a job, which prints its own usage
+            continue;
+        }
+
         executablePath[0] = '\0';
         findExecutablePath(args[0]);
-        if (checkIO(args) == 1) {
-            handleIO(args);
-        } else if (strcmp(args[0], "search") == 0) {
-            search(args);
-            continue;
-        } else if (strcmp(args[0], "bookmark") == 0) {
-            bookmark(args);
-        } else if (strcmp(args[0], "exit") == 0) {
-            if (backgroundProcessCount > 0) {
-                printf("There are background processes running. Please terminate them first.\n");
-                continue;
-            } else {
-                exit(0);
-            }
+        if (redirected == 1) {
+            handleIO(args, background);
         } else if (isExecutable(executablePath)) {
             if (strcmp(args[numberOfArguments - 1], "&") == 0) {
                 args[numberOfArguments - 1] = '\0';
@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# Run the bookmark cases of the shell in script mode, in a temporary directory
+# with a bookmark file of its own. Prints the cases that fail and exits with 1 if any does.
+directory="$(cd "$(dirname "$0")" && pwd)"
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+gcc -Wall -Wextra -O2 -pthread -o "$work/myshell" "$directory/150120035_150120004_150121025.c" || exit 1
+failures=0
+
+# Run a script with a new bookmark file and check its output and the errors of the shell
+# $1: name of the case, $2: script, $3: expected output, with the durations as TIME,
+# $4: expected text in the errors, or nothing
+runCase() {
+	rm -f "$work/bookmarks" "$work/stdError.txt"
+	printf '%s\n' "$2" >"$work/script.txt"
+	start=$SECONDS
+	output=$(cd "$work" && MYSHELL_BOOKMARKS="$work/bookmarks" timeout 10 ./myshell script.txt 2>/dev/null)
+	status=$?
+	output=$(printf '%s\n' "$output" | sed 's/[0-9]*\.[0-9]* s$/TIME/')
+	if [ $status -ge 124 ]; then
+		echo "FAIL $1: the shell exited with $status"
+		failures=$((failures + 1))
+	elif [ "$output" != "$3" ]; then
+		echo "FAIL $1: the output is \"$output\" instead of \"$3\""
+		failures=$((failures + 1))
+	elif [ $((SECONDS - start)) -ge 2 ]; then
+		echo "FAIL $1: the case took $((SECONDS - start)) s"
+		failures=$((failures + 1))
+	elif [ -n "$4" ] && ! grep -qF "$4" "$work/stdError.txt"; then
+		echo "FAIL $1: the errors do not contain \"$4\""
+		failures=$((failures + 1))
+	else
+		echo "ok   $1"
+	fi
+}
+
+runCase "bookmark running itself" \
+	'bookmark "bookmark -i 0"
+bookmark -i 0
+echo after' \
+	"after" "Error: bookmark 0 is already running"
+
+runCase "bookmarks running each other" \
+	'bookmark "bookmark -i 1"
+bookmark "bookmark -i 0"
+bookmark -i 0
+echo after' \
+	"after" "Error: bookmark 0 is already running"
+
+runCase "bookmark deleting a bookmark" \
+	'bookmark "bookmark -d 0"
+bookmark -i 0
+bookmark -l' \
+	'0 "bookmark -d 0"' "Error: a bookmark cannot be deleted while a bookmark is running"
+
+runCase "parallel bookmark running itself" \
+	'bookmark "bookmark -i 0,0 -j 2"
+bookmark -i 0 -j 2
+echo after' \
+	"bookmark 0: exit 1, TIME
+bookmark 0: exit 1, TIME
+bookmark 0: exit 1, TIME
+after" "Error: bookmark 0 is already running"
+
+# the processes started by sh are terminated along with it, so the set ends long before the sleep
+runCase "fail-fast with sh bookmarks" \
+	'bookmark "sleep 5; echo done"
+bookmark "false"
+bookmark -i 0-1 -j 2 -f
+echo after' \
+	"bookmark 0: Terminated, TIME
+bookmark 1: exit 1, TIME
+after" ""
+
+exit $((failures > 0))
@@ -1,10 +1,80 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define CACHE_LINE_SIZE 64
+#define METHOD_COUNT 5
+
+#define POOL_MIN_CHUNK 4096             /* smallest and first chunk size of a pool worker */
+#define POOL_MAX_CHUNK (1LL << 26)
+#define POOL_CHUNK_SECONDS 0.001        /* chunk duration the pool workers aim for */
+
+#define PRECISE_BLOCK_SIZE 65536        /* smallest block of the precise mode */
+#define PRECISE_MAX_BLOCKS (1LL << 19)  /* the blocks grow for ranges that would need more */
+
+#define CHECKPOINT_MAGIC "P3CKPT02"
+#define CHECKPOINT_POLL_NANOSECONDS 50000000 /* how often the main thread checks if the threads are done */
 
 double global_sqrt_sum = 0;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+double mutexWaitSeconds = 0;    /* time the threads of method 2 spent waiting for the mutex in the last run */
+
+#define PLACEMENT_NONE 0    /* the scheduler places the workers */
+#define PLACEMENT_COMPACT 1 /* "--affinity compact" */
+#define PLACEMENT_SCATTER 2 /* "--affinity scatter" */
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;           /* core id in the package, shared by the hyper-threads of the core */
+    int node;
+    int coreRank;       /* rank of the core in its package */
+    int siblingRank;    /* rank of the CPU among the hyper-threads of its core */
+} CpuInfo;
+
+CpuInfo *cpus = NULL;   /* CPUs the process may run on, in placement order */
+int cpuCount = 0;
+int physicalCoreCount = 0;
+int placement = PLACEMENT_NONE;
+
+int readSysfsNumber(const char *path, int fallback);
+
+int compareCompact(const void *first, const void *second);
+
+int compareScatter(const void *first, const void *second);
+
+void loadCpuTopology(void);
+
+void setPlacement(int policy);
+
+int parsePlacement(const char *name);
+
+void printPlacement(FILE *stream, int numberOfThreads);
+
+int createWorkerThread(pthread_t *thread, int workerIndex, void *(*routine)(void *), void *args);
+
+/* The threads of the generic reduction are pinned like the others, and pinned threads keep their results local. */
+#define RANGE_REDUCE_CREATE_THREAD(thread, index, routine, args) createWorkerThread(thread, index, routine, args)
+#define RANGE_REDUCE_LOCAL_RESULTS (placement != PLACEMENT_NONE)
+#include "range_reduce.h"
 
 void *method1(void *args);
 
@@ -12,19 +82,615 @@ void *method2(void *args);
 
 void *method3(void *args);
 
-void executeMethod1(long long int a, long long int b, int numberOfThreads, long long int rangePerThread);
+double executeMethod1(long long int a, long long int b, int numberOfThreads);
+
+double executeMethod2(long long int a, long long int b, int numberOfThreads);
+
+double executeMethod3(long long int a, long long int b, int numberOfThreads);
+
+double executeMethod4(long long int a, long long int b, int numberOfThreads);
+
+void runMethodThreads(void *(*method)(void *), long long int a, long long int b, int numberOfThreads);
+
+double executeMethod5(long long int a, long long int b, int numberOfThreads);
+
+double executeMethod4Precise(long long int a, long long int b, int numberOfThreads);
+
+void *method4Precise(void *args);
+
+double estimateSqrtSum(long long int a, long long int b);
+
+double sumSquareRootsScalar(long long int start, long long int end);
+
+double sumSquareRootsAvx2(long long int start, long long int end);
+
+double sumSquareRootsAvx512(long long int start, long long int end);
+
+void selectSqrtSumKernel(void);
+
+double executeMethod(int methodNumber, long long int a, long long int b, int numberOfThreads);
+
+#define BENCHMARK_TABLE 0
+#define BENCHMARK_CSV 1
+#define BENCHMARK_JSON 2
+
+typedef struct {
+    long long int a;            /* first number of every range */
+    long long int minRange;     /* the lengths of the ranges go from minRange to maxRange, multiplied by 10 */
+    long long int maxRange;
+    int maxThreads;             /* the numbers of threads go from 1 to maxThreads */
+    int allThreads;             /* 1 to measure every number of threads, 0 for the powers of two and maxThreads */
+    int methods[METHOD_COUNT + 1]; /* methods[n] is 1 if method n is measured */
+    int repetitions;            /* measured runs of every configuration */
+    int warmups;                /* runs before the measured ones */
+    int format;                 /* BENCHMARK_TABLE, BENCHMARK_CSV or BENCHMARK_JSON */
+} BenchmarkOptions;
+
+typedef struct {
+    int methodNumber;
+    int threads;
+    long long int elements;
+    double medianSeconds;
+    double minSeconds;
+    double nanosecondsPerElement;
+    double elementsPerSecond;
+    double elementsPerSecondPerCore;
+    double speedup;             /* over the single-threaded run of the same method and range */
+    double efficiency;          /* speedup divided by the number of threads */
+    double mutexWaitSeconds;    /* only measured for method 2 */
+    double sum;
+} BenchmarkResult;
+
+int parseMethodList(const char *list, int methods[METHOD_COUNT + 1]);
+
+int compareDoubles(const void *first, const void *second);
+
+void printBenchmarkResults(const BenchmarkOptions *options, const BenchmarkResult *results, int resultCount);
+
+int nextBenchmarkThreads(const BenchmarkOptions *options, int numberOfThreads);
+
+void benchmarkMethods(const BenchmarkOptions *options);
 
-void executeMethod2(long long int a, long long int b, int numberOfThreads, long long int rangePerThread);
+int runBenchmark(int argc, char *argv[]);
 
-void executeMethod3(long long int a, long long int b, int numberOfThreads, long long int rangePerThread);
+double currentSeconds(void);
 
 typedef struct {
     long long int start;
     long long int end;
 } ThreadParameters;
 
+typedef struct ThreadPool ThreadPool;
+
+/* A thread of the pool. The numbers from next to end are the range it takes chunks from, and other workers steal from. */
+typedef struct {
+    ThreadPool *pool;
+    int index;
+    pthread_t thread;
+    pthread_mutex_t lock;   /* protects next and end */
+    long long int next;
+    long long int end;
+    long long int chunkSize;
+    double sum;             /* partial sum of the last run */
+    long long int elements; /* statistics of the last run */
+    long int chunks;
+    long int steals;
+    double busySeconds;
+} __attribute__((aligned(CACHE_LINE_SIZE))) PoolWorker;
+
+struct ThreadPool {
+    PoolWorker *workers;
+    int workerCount;
+    pthread_mutex_t lock;   /* protects generation, runningWorkers and shutdown */
+    pthread_cond_t start;   /* signaled when a run starts or the pool shuts down */
+    pthread_cond_t done;    /* signaled when the last worker finishes a run */
+    int generation;         /* number of runs started, the workers wait for it to change */
+    int runningWorkers;
+    int shutdown;
+};
+
+ThreadPool *threadPool = NULL;  /* pool of method 5, kept between runs */
+
+int takeChunk(PoolWorker *worker, long long int *start, long long int *end);
+
+void *poolWorker(void *args);
+
+ThreadPool *createThreadPool(int workerCount);
+
+void destroyThreadPool(ThreadPool *pool);
+
+double runThreadPool(ThreadPool *pool, long long int a, long long int b);
+
+void printPoolStatistics(ThreadPool *pool);
+
+/* A sum and the rounding error lost while computing it. */
+typedef struct {
+    double sum;
+    double compensation;
+} CompensatedSum;
+
+typedef struct {
+    long long int a;
+    long long int b;
+    long long int blockSize;
+    long long int firstBlock;   /* the thread sums the blocks from firstBlock to endBlock - 1 */
+    long long int endBlock;
+    CompensatedSum *blockSums;
+} PreciseParameters;
+
+CompensatedSum addCompensated(CompensatedSum x, CompensatedSum y);
+
+CompensatedSum preciseSumScalar(long long int start, long long int end);
+
+CompensatedSum preciseSumAvx2(long long int start, long long int end);
+
+CompensatedSum preciseSumAvx512(long long int start, long long int end);
+
+/* Like SqrtSumKernel, with compensated summation. */
+typedef CompensatedSum (*PreciseSumKernel)(long long int start, long long int end);
+
+PreciseSumKernel preciseSumKernel = preciseSumScalar;   /* chosen with sqrtSumKernel */
+
+int preciseMode = 0;    /* "--precise": method 4 uses compensated summation and a deterministic reduction */
+
+const char *checkpointPath = NULL;  /* "--checkpoint FILE": method 4 saves its progress to FILE */
+double checkpointInterval = 10;     /* "--checkpoint-interval SECONDS" */
+
+/* The checkpoint file is this header, a done flag per block, then a compensated sum per block. */
+typedef struct {
+    char magic[8];
+    long long int a;
+    long long int b;
+    long long int blockSize;
+    long long int blockCount;
+    long long int precise;      /* block sums of the precise mode are not mixed with the others */
+    char kernel[8];             /* sqrtSumKernelName: block sums of different kernels are not mixed either */
+} CheckpointHeader;
+
+typedef struct {
+    const char *path;
+    long long int a;
+    long long int b;
+    long long int blockSize;
+    long long int blockCount;
+    long long int nextBlock;        /* next block to be taken by a thread */
+    int finishedWorkers;
+    unsigned char *done;            /* done[i] is set once the sum of block i is stored */
+    CompensatedSum *blockSums;
+    unsigned char *doneSnapshot;    /* copies written to the checkpoint file */
+    CompensatedSum *sumSnapshot;
+} CheckpointState;
+
+long long int preciseBlockSize(long long int length);
+
+void *method4Checkpointed(void *args);
+
+long long int loadCheckpoint(CheckpointState *state);
+
+int writeCheckpoint(CheckpointState *state);
+
+double executeMethod4Checkpointed(long long int a, long long int b, int numberOfThreads);
+
+#define MAX_WORKER_CONNECTIONS 64
+#define COORDINATOR_POLL_MILLISECONDS 100
+#define COORDINATOR_RECEIVE_SECONDS 1   /* longest wait for the rest of a message the coordinator started to read */
+#define HEARTBEAT_SECONDS 1             /* how often a worker tells the coordinator it is still calculating a shard */
+
+#define MESSAGE_HELLO 0     /* worker to coordinator, start holds the pid of the worker */
+#define MESSAGE_SHARD 1     /* coordinator to worker: calculate the numbers from start to end */
+#define MESSAGE_RESULT 2    /* worker to coordinator: sum holds the sum of the shard */
+#define MESSAGE_SHUTDOWN 3  /* coordinator to worker: every shard is done */
+#define MESSAGE_HEARTBEAT 4 /* worker to coordinator: still calculating the shard */
+
+/* The only message of the coordinator protocol; both sides run on the same machine, so it is sent as is. */
+typedef struct {
+    int type;
+    int shard;
+    long long int start;
+    long long int end;
+    double sum;
+} ShardMessage;
+
+#define SHARD_PENDING 0
+#define SHARD_ASSIGNED 1
+#define SHARD_DONE 2
+
+typedef struct {
+    long long int start;
+    long long int end;
+    int state;
+    double sum;
+} Shard;
+
+typedef struct {
+    int fd;             /* -1 if the slot is free */
+    pid_t pid;
+    int shard;          /* shard being calculated, -1 if the worker is idle */
+    int greeted;        /* 1 once the worker sent its HELLO, before which it gets no shard */
+    double heardAt;     /* time of the last message from the worker, or of the connection or the last assignment */
+} WorkerConnection;
+
+/* The heartbeat thread of a worker, which runs while the worker calculates a shard. */
+typedef struct {
+    int fd;
+    int shard;
+    int finished;       /* set by the worker once the shard is calculated */
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} Heartbeat;
+
+typedef struct {
+    Shard *shards;
+    int shardCount;
+    WorkerConnection connections[MAX_WORKER_CONNECTIONS];
+    pid_t children[MAX_WORKER_CONNECTIONS]; /* local workers that are running */
+    int childCount;
+} Coordinator;
+
+int transferMessage(int fd, ShardMessage *message, int writing);
+
+void *sendHeartbeats(void *args);
+
+int runShardWorker(const char *socketPath, int numberOfThreads);
+
+pid_t spawnShardWorker(const char *socketPath, int numberOfThreads);
+
+void dropShardWorker(Coordinator *coordinator, int index, const char *reason);
+
+void assignShard(Coordinator *coordinator, int index);
+
+int runCoordinator(long long int a, long long int b, int workerCount, int threadsPerWorker, int shardCount,
+                   const char *socketPath, double stallSeconds);
+
+int runCoordinatorMode(int argc, char *argv[]);
+
+/* Adds up the square roots of the numbers from start to end, both included. */
+typedef double (*SqrtSumKernel)(long long int start, long long int end);
+
+SqrtSumKernel sqrtSumKernel = sumSquareRootsScalar; /* fastest kernel the CPU supports, chosen by selectSqrtSumKernel */
+const char *sqrtSumKernelName = "scalar";
+
+
+/**
+ * @brief Reads a number from a sysfs file.
+ *
+ * @param path The path of the file.
+ * @param fallback The value returned if the file cannot be read.
+ * @return The number in the file, or 'fallback'.
+ */
+int readSysfsNumber(const char *path, int fallback) {
+    FILE *file = fopen(path, "r");
+    int value;
+    if (file == NULL)
+        return fallback;
+    if (fscanf(file, "%d", &value) != 1)
+        value = fallback;
+    fclose(file);
+    return value;
+}
+
+/**
+ * @brief Compares two CPUs in compact order: package, node, core, then the hyper-threads of a core.
+ */
+int compareCompact(const void *first, const void *second) {
+    const CpuInfo *x = (const CpuInfo *) first, *y = (const CpuInfo *) second;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->node != y->node)
+        return x->node - y->node;
+    if (x->coreRank != y->coreRank)
+        return x->coreRank - y->coreRank;
+    return x->siblingRank - y->siblingRank;
+}
+
+/**
+ * @brief Compares two CPUs in scatter order: one hyper-thread of every core first, going around the packages.
+ */
+int compareScatter(const void *first, const void *second) {
+    const CpuInfo *x = (const CpuInfo *) first, *y = (const CpuInfo *) second;
+    if (x->siblingRank != y->siblingRank)
+        return x->siblingRank - y->siblingRank;
+    if (x->coreRank != y->coreRank)
+        return x->coreRank - y->coreRank;
+    if (x->package != y->package)
+        return x->package - y->package;
+    return x->node - y->node;
+}
+
+/**
+ * @brief Reads the topology of the CPUs the process may run on from /sys/devices/system/cpu.
+ *
+ * For every CPU of the affinity mask of the process, the package, the core and the NUMA node are read. Then every CPU
+ * gets the rank of its core in its package and its rank among the hyper-threads of its core, which the placement
+ * orders are built from. CPUs whose topology files are missing count as separate cores of package 0 and node 0.
+ */
+void loadCpuTopology(void) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        for (int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &allowed);
+        }
+    }
+    cpus = malloc(CPU_COUNT(&allowed) * sizeof(CpuInfo));
+    if (cpus == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    cpuCount = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        CpuInfo *info = &cpus[cpuCount++];
+        char path[128];
+        info->cpu = cpu;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        info->package = readSysfsNumber(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        info->core = readSysfsNumber(path, cpu);
+        info->node = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        DIR *directory = opendir(path);
+        if (directory != NULL) {
+            struct dirent *entry;
+            while ((entry = readdir(directory)) != NULL) {
+                if (!strncmp(entry->d_name, "node", 4) && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+                    info->node = atoi(entry->d_name + 4);
+                    break;
+                }
+            }
+            closedir(directory);
+        }
+    }
+
+    physicalCoreCount = 0;
+    for (int i = 0; i < cpuCount; ++i) {
+        cpus[i].siblingRank = 0;
+        cpus[i].coreRank = 0;
+        int firstSibling = 1;
+        for (int j = 0; j < i; ++j) {
+            if (cpus[j].package != cpus[i].package)
+                continue;
+            if (cpus[j].core == cpus[i].core) {
+                cpus[i].siblingRank++;
+                if (firstSibling)
+                    cpus[i].coreRank = cpus[j].coreRank;
+                firstSibling = 0;
+            }
+        }
+        if (firstSibling) {
+            // a new core: its rank is the number of cores of the package seen so far
+            for (int j = 0; j < i; ++j) {
+                if (cpus[j].package == cpus[i].package && cpus[j].siblingRank == 0)
+                    cpus[i].coreRank++;
+            }
+            physicalCoreCount++;
+        }
+    }
+}
+
+/**
+ * @brief Chooses where the workers run.
+ *
+ * @param policy PLACEMENT_NONE, PLACEMENT_COMPACT or PLACEMENT_SCATTER.
+ *
+ * The CPUs are sorted in the order of the policy, and worker i is pinned to the i-th CPU (going around if there are
+ * more workers than CPUs). Compact placement fills the cores of one package, and their hyper-threads, before the next
+ * package, which keeps the workers close to their shared caches. Scatter placement gives every worker a core of its
+ * own while there are free cores, going around the packages, which spreads the workers over the memory controllers.
+ */
+void setPlacement(int policy) {
+    placement = policy;
+    if (policy == PLACEMENT_NONE)
+        return;
+    qsort(cpus, cpuCount, sizeof(CpuInfo), policy == PLACEMENT_COMPACT ? compareCompact : compareScatter);
+}
+
+/**
+ * @brief Converts the name of a placement policy to its number.
+ *
+ * @param name "none", "compact" or "scatter".
+ * @return The policy, or -1 if the name is not known.
+ */
+int parsePlacement(const char *name) {
+    if (!strcmp(name, "none"))
+        return PLACEMENT_NONE;
+    if (!strcmp(name, "compact"))
+        return PLACEMENT_COMPACT;
+    if (!strcmp(name, "scatter"))
+        return PLACEMENT_SCATTER;
+    return -1;
+}
+
+/**
+ * @brief Prints where the workers of a run are placed.
+ *
+ * @param stream The stream to print to.
+ * @param numberOfThreads The number of workers.
+ */
+void printPlacement(FILE *stream, int numberOfThreads) {
+    static const char *names[] = {"none", "compact", "scatter"};
+    fprintf(stream, "Placement: %s, %d threads, %d CPUs, %d cores\n", names[placement], numberOfThreads, cpuCount,
+            physicalCoreCount);
+    if (placement == PLACEMENT_NONE)
+        return;
+    for (int i = 0; i < numberOfThreads; ++i) {
+        const CpuInfo *info = &cpus[i % cpuCount];
+        fprintf(stream, "  worker %d -> cpu %d (node %d, package %d, core %d)\n", i, info->cpu, info->node,
+                info->package, info->core);
+    }
+}
+
+/**
+ * @brief Creates the thread of a worker, pinned to its CPU if a placement was chosen.
+ *
+ * @param thread The thread is stored here.
+ * @param workerIndex The index of the worker, which selects its CPU.
+ * @param routine The function the thread runs.
+ * @param args The argument of the function.
+ * @return The result of pthread_create.
+ */
+int createWorkerThread(pthread_t *thread, int workerIndex, void *(*routine)(void *), void *args) {
+    if (placement == PLACEMENT_NONE)
+        return pthread_create(thread, NULL, routine, args);
+
+    pthread_attr_t attributes;
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpus[workerIndex % cpuCount].cpu, &cpuSet);
+    pthread_attr_init(&attributes);
+    pthread_attr_setaffinity_np(&attributes, sizeof(cpuSet), &cpuSet);
+    int result = pthread_create(thread, &attributes, routine, args);
+    pthread_attr_destroy(&attributes);
+    return result;
+}
+
+/**
+ * @brief Calculates the sum of square roots for a range of numbers, one number at a time.
+ *
+ * This is the kernel used when the CPU has no vector instructions for it, and the tail of the vector kernels.
+ *
+ * @param start The first number of the range.
+ * @param end The last number of the range.
+ * @return The sum of the square roots of the numbers from 'start' to 'end'.
+ */
+double sumSquareRootsScalar(long long int start, long long int end) {
+    double sum = 0;
+
+    for (long long int i = start; i <= end; ++i) {
+        sum += sqrt((double) i);
+    }
+    return sum;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * @brief Calculates the sum of square roots for a range of numbers, 4 numbers at a time with AVX2.
+ *
+ * The numbers are kept as doubles in a vector register and increased by the lane width, so no integer is converted
+ * in the loop; this is exact as long as the numbers fit in the 53 bits of a double. Four independent accumulators
+ * hide the latency of the square root and of the addition.
+ *
+ * @param start The first number of the range.
+ * @param end The last number of the range.
+ * @return The sum of the square roots of the numbers from 'start' to 'end'.
+ */
+__attribute__((target("avx2")))
+double sumSquareRootsAvx2(long long int start, long long int end) {
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+    __m256d step = _mm256_set1_pd(4.0);
+    __m256d value0 = _mm256_add_pd(_mm256_set1_pd((double) start), _mm256_setr_pd(0, 1, 2, 3));
+    __m256d value1 = _mm256_add_pd(value0, step);
+    __m256d value2 = _mm256_add_pd(value1, step);
+    __m256d value3 = _mm256_add_pd(value2, step);
+    __m256d blockStep = _mm256_set1_pd(16.0);
+    long long int i = start;
+
+    for (; end - i >= 15; i += 16) {
+        sum0 = _mm256_add_pd(sum0, _mm256_sqrt_pd(value0));
+        sum1 = _mm256_add_pd(sum1, _mm256_sqrt_pd(value1));
+        sum2 = _mm256_add_pd(sum2, _mm256_sqrt_pd(value2));
+        sum3 = _mm256_add_pd(sum3, _mm256_sqrt_pd(value3));
+        value0 = _mm256_add_pd(value0, blockStep);
+        value1 = _mm256_add_pd(value1, blockStep);
+        value2 = _mm256_add_pd(value2, blockStep);
+        value3 = _mm256_add_pd(value3, blockStep);
+    }
+
+    __m256d total = _mm256_add_pd(_mm256_add_pd(sum0, sum1), _mm256_add_pd(sum2, sum3));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, total);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + (i <= end ? sumSquareRootsScalar(i, end) : 0);
+}
+
+/**
+ * @brief Calculates the sum of square roots for a range of numbers, 8 numbers at a time with AVX-512.
+ *
+ * This works like sumSquareRootsAvx2, with vectors of 8 doubles.
+ *
+ * @param start The first number of the range.
+ * @param end The last number of the range.
+ * @return The sum of the square roots of the numbers from 'start' to 'end'.
+ */
+__attribute__((target("avx512f")))
+double sumSquareRootsAvx512(long long int start, long long int end) {
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    __m512d sum2 = _mm512_setzero_pd(), sum3 = _mm512_setzero_pd();
+    __m512d step = _mm512_set1_pd(8.0);
+    __m512d value0 = _mm512_add_pd(_mm512_set1_pd((double) start), _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7));
+    __m512d value1 = _mm512_add_pd(value0, step);
+    __m512d value2 = _mm512_add_pd(value1, step);
+    __m512d value3 = _mm512_add_pd(value2, step);
+    __m512d blockStep = _mm512_set1_pd(32.0);
+    long long int i = start;
+
+    for (; end - i >= 31; i += 32) {
+        sum0 = _mm512_add_pd(sum0, _mm512_sqrt_pd(value0));
+        sum1 = _mm512_add_pd(sum1, _mm512_sqrt_pd(value1));
+        sum2 = _mm512_add_pd(sum2, _mm512_sqrt_pd(value2));
+        sum3 = _mm512_add_pd(sum3, _mm512_sqrt_pd(value3));
+        value0 = _mm512_add_pd(value0, blockStep);
+        value1 = _mm512_add_pd(value1, blockStep);
+        value2 = _mm512_add_pd(value2, blockStep);
+        value3 = _mm512_add_pd(value3, blockStep);
+    }
+
+    __m512d total = _mm512_add_pd(_mm512_add_pd(sum0, sum1), _mm512_add_pd(sum2, sum3));
+    return _mm512_reduce_add_pd(total) + (i <= end ? sumSquareRootsScalar(i, end) : 0);
+}
+
+#else
+
+double sumSquareRootsAvx2(long long int start, long long int end) {
+    return sumSquareRootsScalar(start, end);
+}
+
+double sumSquareRootsAvx512(long long int start, long long int end) {
+    return sumSquareRootsScalar(start, end);
+}
 
+#endif
 
+/**
+ * @brief Chooses the fastest square root kernels the CPU supports, for the normal and the precise mode.
+ *
+ * AVX-512 is preferred over AVX2, and the scalar kernel is used on other CPUs. The PROJECT3_KERNEL environment
+ * variable ("scalar", "avx2" or "avx512") forces a kernel, which is useful to compare them on the same machine. A forced
+ * kernel the CPU does not support falls back to the fastest one it does, with a warning naming the kernel used.
+ */
+void selectSqrtSumKernel(void) {
+    static const char *names[] = {"scalar", "avx2", "avx512"};
+    static const SqrtSumKernel kernels[] = {sumSquareRootsScalar, sumSquareRootsAvx2, sumSquareRootsAvx512};
+    static const PreciseSumKernel preciseKernels[] = {preciseSumScalar, preciseSumAvx2, preciseSumAvx512};
+    const char *forced = getenv("PROJECT3_KERNEL");
+    int supported = 0; /* index of the fastest kernel the CPU supports */
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        supported = 2;
+    else if (__builtin_cpu_supports("avx2"))
+        supported = 1;
+#endif
+
+    int chosen = supported;
+    if (forced != NULL) {
+        int wanted = 0;
+        while (wanted < 3 && strcmp(forced, names[wanted]))
+            wanted++;
+        if (wanted == 3)
+            fprintf(stderr, "Unknown PROJECT3_KERNEL %s, using %s\n", forced, names[supported]);
+        else if (wanted > supported)
+            fprintf(stderr, "PROJECT3_KERNEL %s is not supported by this CPU, using %s\n", forced, names[supported]);
+        else
+            chosen = wanted;
+    }
+    sqrtSumKernel = kernels[chosen];
+    preciseSumKernel = preciseKernels[chosen];
+    sqrtSumKernelName = names[chosen];
+}
 
 /**
  * @brief Calculates the square root of numbers in a given range and updates a global sum.
@@ -52,6 +718,7 @@ void *method1(void *args) {
  * This method is designed to be run in a separate thread to perform the calculation concurrently with other threads.
  * It takes a pointer to a `ThreadParameters` struct as a parameter, which specifies the start and end values of the range for the calculation.
  * The calculated sum is added to the `global_sqrt_sum` variable, using a mutex to ensure thread safety.
+ * The time spent waiting for the mutex while another thread holds it is added to `mutexWaitSeconds`.
  *
  * @param args Pointer to a `ThreadParameters` struct containing the start and end values of the range.
  * @return Void.
@@ -59,11 +726,22 @@ void *method1(void *args) {
 void *method2(void *args) {
     ThreadParameters *threadParameters = (ThreadParameters *) args;
 
+    double waitSeconds = 0;
+
     for (long long int i = threadParameters->start; i <= threadParameters->end; ++i) {
-        pthread_mutex_lock(&mutex);
+        // the wait is only timed when the mutex is taken, so the uncontended path costs the same as before
+        if (pthread_mutex_trylock(&mutex) != 0) {
+            double waitStart = currentSeconds();
+            pthread_mutex_lock(&mutex);
+            waitSeconds += currentSeconds() - waitStart;
+        }
         global_sqrt_sum += sqrt((double) i);
         pthread_mutex_unlock(&mutex);
     }
+
+    pthread_mutex_lock(&mutex);
+    mutexWaitSeconds += waitSeconds;
+    pthread_mutex_unlock(&mutex);
     pthread_exit(NULL);
 }
 
@@ -74,7 +752,8 @@ void *method2(void *args) {
  *
  * This function is used to calculate the sum of square roots for a range of numbers using multiple threads.
  * It receives a struct of type `ThreadParameters` as an argument, which contains the start and end values for the range.
- * Each thread calculates the square root of each number in the range and adds it to a local_sum variable.
+ * Each thread calculates the sum of the square roots of the numbers in the range into a local_sum variable,
+ * with the kernel chosen by selectSqrtSumKernel.
  * The local_sum is then added to the global_sqrt_sum using a mutex lock to ensure thread-safe access.
  *
  * @param args A void pointer to a struct of type `ThreadParameters` that defines the range of numbers to calculate the sum of square roots.
@@ -86,11 +765,7 @@ void *method2(void *args) {
  */
 void *method3(void *args) {
     ThreadParameters *threadParameters = (ThreadParameters *) args;
-    double local_sqrt_sum = 0;
-
-    for (long long int i = threadParameters->start; i <= threadParameters->end; ++i) {
-        local_sqrt_sum += sqrt((double) i);
-    }
+    double local_sqrt_sum = sqrtSumKernel(threadParameters->start, threadParameters->end);
 
     pthread_mutex_lock(&mutex);
     global_sqrt_sum += local_sqrt_sum;
@@ -101,139 +776,1625 @@ void *method3(void *args) {
 
 
 /**
- * @brief Executes method 3 with multiple threads.
+ * @brief Returns the current time of the monotonic clock in seconds.
  *
- * This function divides the range between 'a' and 'b' into 'numberOfThreads'
- * parts and creates a thread for each part to calculate the sum of square roots.
- * Each thread receives a 'start' and 'end' value specifying the range of values to
- * calculate the sum of square roots. The main thread waits for all threads to finish
- * before printing the final result.
+ * @return The current time in seconds.
+ */
+double currentSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Takes the next chunk of a worker, first from its own range and then by stealing from the other workers.
  *
- * @param a The lower bound of the range.
- * @param b The upper bound of the range.
- * @param numberOfThreads The number of threads to create.
- * @param rangePerThread The size of the range to assign to each thread.
+ * The worker takes 'chunkSize' numbers from the front of its own range. When its range is empty, it visits the other
+ * workers, starting with the next one, and steals the back half of the first range that is not empty. The stolen
+ * numbers become the worker's own range, so later chunks are taken without visiting the victim again.
+ *
+ * @param worker The worker that needs a chunk.
+ * @param start The first number of the chunk is stored here.
+ * @param end The last number of the chunk is stored here.
+ * @return 1 if a chunk was taken, 0 if every range is empty.
  */
-void executeMethod3(long long int a, long long int b, int numberOfThreads, long long int rangePerThread) {
-    pthread_t threads[numberOfThreads];
-    ThreadParameters threadArgs[numberOfThreads];
-    // Calculate the rangePerThread for each thread
-    for (int i = 0; i < numberOfThreads; ++i) {
-        threadArgs[i].start = a + i * rangePerThread;
-        if (i == (numberOfThreads - 1)) {
-            threadArgs[i].end = b;
-        } else {
-            threadArgs[i].end = a + (i + 1) * rangePerThread - 1;
+int takeChunk(PoolWorker *worker, long long int *start, long long int *end) {
+    ThreadPool *pool = worker->pool;
+
+    for (int attempt = 0; attempt < pool->workerCount; ++attempt) {
+        PoolWorker *victim = &pool->workers[(worker->index + attempt) % pool->workerCount];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next > victim->end) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
         }
-        pthread_create(&threads[i], NULL, method3, (void *) &threadArgs[i]);
-    }
-    // Wait for all threads to finish
-    for (int i = 0; i < numberOfThreads; ++i) {
-        pthread_join(threads[i], NULL);
+        if (victim == worker) {
+            *start = worker->next;
+            *end = worker->end - worker->next + 1 > worker->chunkSize ? worker->next + worker->chunkSize - 1 : worker->end;
+            worker->next = *end + 1;
+            pthread_mutex_unlock(&worker->lock);
+            return 1;
+        }
+        long long int stolenStart = victim->next + (victim->end - victim->next + 1) / 2;
+        long long int stolenEnd = victim->end;
+        victim->end = stolenStart - 1;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&worker->lock);
+        worker->next = stolenStart;
+        worker->end = stolenEnd;
+        worker->steals++;
+        pthread_mutex_unlock(&worker->lock);
+        // take the first chunk of the stolen range from the own range
+        attempt = -1;
     }
-    printf("Method 3: \n");
-    printf("The sum of square roots between %lld and %lld is: %.5e\n", a, b, global_sqrt_sum);
+    return 0;
 }
 
 /**
-  * @brief Executes method 2 with parallel threads.
-  *
-  * This function executes method 2 with parallel threads. It divides the range from 'a' to 'b' into
-  * 'numberOfThreads' sub-ranges, and assigns each sub-range to a separate thread. Each thread
-  * calculates the sum of square roots within its assigned sub-range. The final result is the sum of
-  * square roots from all threads.
-  *
-  * @param a                 The starting value of the range.
-  * @param b                 The ending value of the range.
-  * @param numberOfThreads   The number of threads to be used for parallel execution.
-  * @param rangePerThread    The range of values assigned to each thread.
-  * @see method2
-  */
-void executeMethod2(long long int a, long long int b, int numberOfThreads, long long int rangePerThread) {
-    pthread_t threads[numberOfThreads];
-    ThreadParameters threadArgs[numberOfThreads];
+ * @brief The loop of a thread of the pool.
+ *
+ * The thread sleeps until the pool starts a new run, then takes chunks with takeChunk and adds up their square roots
+ * into its own padded slot until every range is empty. The chunk size adapts to the time a chunk takes: it is doubled
+ * when a chunk finishes in less than half of POOL_CHUNK_SECONDS and halved when it takes more than twice as long, so
+ * chunks are large enough to make taking them cheap and small enough to balance the load at the end of a run.
+ *
+ * @param args A pointer to the `PoolWorker` of the thread.
+ * @return None.
+ */
+void *poolWorker(void *args) {
+    PoolWorker *worker = (PoolWorker *) args;
+    ThreadPool *pool = worker->pool;
+    int generation = 0;
 
-    // Calculate the rangePerThread for each thread
-    for (int i = 0; i < numberOfThreads; ++i) {
-        threadArgs[i].start = a + i * rangePerThread;
-        if (i == (numberOfThreads - 1)) {
-            threadArgs[i].end = b;
-        } else {
-            threadArgs[i].end = a + (i + 1) * rangePerThread - 1;
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == generation && !pool->shutdown)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
         }
-        pthread_create(&threads[i], NULL, method2, (void *) &threadArgs[i]);
-    }
-    // Wait for all threads to finish
-    for (int i = 0; i < numberOfThreads; ++i) {
-        pthread_join(threads[i], NULL);
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        long long int start, end;
+        double sum = 0, busySeconds = 0;
+        while (takeChunk(worker, &start, &end)) {
+            double chunkStart = currentSeconds();
+            sum += sqrtSumKernel(start, end);
+            double chunkSeconds = currentSeconds() - chunkStart;
+            busySeconds += chunkSeconds;
+            worker->chunks++;
+            worker->elements += end - start + 1;
+            if (end - start + 1 < worker->chunkSize)
+                continue;   // the end of a range says nothing about the speed
+            if (chunkSeconds < POOL_CHUNK_SECONDS / 2 && worker->chunkSize < POOL_MAX_CHUNK)
+                worker->chunkSize *= 2;
+            else if (chunkSeconds > POOL_CHUNK_SECONDS * 2 && worker->chunkSize > POOL_MIN_CHUNK)
+                worker->chunkSize /= 2;
+        }
+        worker->sum = sum;
+        worker->busySeconds = busySeconds;
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->runningWorkers == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
     }
-    printf("Method 2: \n");
-    printf("The sum of square roots between %lld and %lld is: %.5e\n", a, b, global_sqrt_sum);
+    return NULL;
 }
 
-
 /**
- * @brief Executes method1 using multiple threads.
+ * @brief Creates a pool of threads that stay alive between runs.
  *
- * This function splits the range [a, b] into smaller ranges and assigns each range to a separate thread. The number
- * of threads is determined by the parameter numberOfThreads. Each thread calculates the sum of square roots within
- * its assigned range and updates the global_sqrt_sum variable. After all threads have finished, the function prints
- * the final result.
+ * @param workerCount The number of threads of the pool.
+ * @return The pool.
+ */
+ThreadPool *createThreadPool(int workerCount) {
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    PoolWorker *workers = aligned_alloc(CACHE_LINE_SIZE, workerCount * sizeof(PoolWorker));
+    if (pool == NULL || workers == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    memset(workers, 0, workerCount * sizeof(PoolWorker));
+    pool->workers = workers;
+    pool->workerCount = workerCount;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int i = 0; i < workerCount; ++i) {
+        workers[i].pool = pool;
+        workers[i].index = i;
+        workers[i].chunkSize = POOL_MIN_CHUNK;
+        pthread_mutex_init(&workers[i].lock, NULL);
+        createWorkerThread(&workers[i].thread, i, poolWorker, (void *) &workers[i]);
+    }
+    return pool;
+}
+
+/**
+ * @brief Stops the threads of a pool and frees it.
  *
- * @param a             The starting value of the range.
- * @param b             The ending value of the range.
- * @param numberOfThreads   The number of threads to use for calculation.
- * @param rangePerThread    The number of values each thread should process.
+ * @param pool The pool.
+ */
+void destroyThreadPool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->workerCount; ++i) {
+        pthread_join(pool->workers[i].thread, NULL);
+        pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * @brief Calculates the sum of square roots between 'a' and 'b' with the threads of a pool.
+ *
+ * The range is first split evenly between the workers, and each worker's part is its range to take chunks from.
+ * The workers that finish early steal from the others, so a thread that is preempted does not hold back the run.
+ * The statistics of the previous run are cleared, and the partial sums are added up in worker order.
+ *
+ * @param pool The pool.
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @return The sum of square roots between 'a' and 'b'.
+ */
+double runThreadPool(ThreadPool *pool, long long int a, long long int b) {
+    long long int rangePerWorker = (b - a + 1) / pool->workerCount;
+
+    for (int i = 0; i < pool->workerCount; ++i) {
+        PoolWorker *worker = &pool->workers[i];
+        worker->next = a + i * rangePerWorker;
+        worker->end = i == pool->workerCount - 1 ? b : a + (i + 1) * rangePerWorker - 1;
+        worker->sum = 0;
+        worker->elements = 0;
+        worker->chunks = 0;
+        worker->steals = 0;
+        worker->busySeconds = 0;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->runningWorkers = pool->workerCount;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    while (pool->runningWorkers > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    double sum = 0;
+    for (int i = 0; i < pool->workerCount; ++i) {
+        sum += pool->workers[i].sum;
+    }
+    return sum;
+}
+
+/**
+ * @brief Prints the load of every worker of a pool in its last run.
+ *
+ * @param pool The pool.
+ */
+void printPoolStatistics(ThreadPool *pool) {
+    long long int totalElements = 0;
+    for (int i = 0; i < pool->workerCount; ++i) {
+        totalElements += pool->workers[i].elements;
+    }
+    printf("%-7s %14s %8s %8s %8s %12s %12s\n", "worker", "elements", "load", "chunks", "steals", "busy (s)",
+           "last chunk");
+    for (int i = 0; i < pool->workerCount; ++i) {
+        PoolWorker *worker = &pool->workers[i];
+        printf("%-7d %14lld %7.2f%% %8ld %8ld %12.4f %12lld\n", i, worker->elements,
+               totalElements > 0 ? 100.0 * (double) worker->elements / (double) totalElements : 0.0, worker->chunks,
+               worker->steals, worker->busySeconds, worker->chunkSize);
+    }
+}
+
+/**
+ * @brief Executes method 5 with the persistent thread pool.
+ *
+ * The pool is created on the first call and reused by the next calls with the same number of threads, so repeated
+ * runs do not pay for creating threads. A different number of threads replaces the pool.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads of the pool.
+ * @return The sum of square roots between 'a' and 'b'.
+ * @see runThreadPool
+ */
+double executeMethod5(long long int a, long long int b, int numberOfThreads) {
+    if (threadPool != NULL && threadPool->workerCount != numberOfThreads) {
+        destroyThreadPool(threadPool);
+        threadPool = NULL;
+    }
+    if (threadPool == NULL)
+        threadPool = createThreadPool(numberOfThreads);
+    return runThreadPool(threadPool, a, b);
+}
+
+
+/**
+ * @brief Adds two compensated sums.
+ *
+ * The rounding error of adding the two sums is found with the TwoSum algorithm and kept in the compensation, so the
+ * result is as accurate as if the sum were kept in about twice the precision of a double.
+ *
+ * @param x The first sum.
+ * @param y The second sum.
+ * @return The compensated sum of 'x' and 'y'.
+ */
+CompensatedSum addCompensated(CompensatedSum x, CompensatedSum y) {
+    CompensatedSum result;
+    result.sum = x.sum + y.sum;
+    double yPart = result.sum - x.sum;
+    double error = (x.sum - (result.sum - yPart)) + (y.sum - yPart);
+    result.compensation = x.compensation + y.compensation + error;
+    return result;
+}
+
+/**
+ * @brief Calculates the compensated sum of square roots for a range of numbers, one number at a time.
+ *
+ * This is Neumaier's variant of Kahan summation. Since every square root is positive, the rounding error of an
+ * addition is the smaller operand minus what the larger one and the result leave of it.
+ *
+ * @param start The first number of the range.
+ * @param end The last number of the range.
+ * @return The compensated sum of the square roots of the numbers from 'start' to 'end'.
+ */
+CompensatedSum preciseSumScalar(long long int start, long long int end) {
+    double sum = 0, compensation = 0;
+
+    for (long long int i = start; i <= end; ++i) {
+        double value = sqrt((double) i);
+        double total = sum + value;
+        compensation += sum >= value ? (sum - total) + value : (value - total) + sum;
+        sum = total;
+    }
+    CompensatedSum result = {sum, compensation};
+    return result;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * @brief Calculates the compensated sum of square roots for a range of numbers with AVX2.
+ *
+ * Every lane of the two accumulators keeps its own Neumaier sum. The larger and smaller operands are found with
+ * max and min instead of a branch, which works because every square root is positive. The lanes are combined in
+ * a fixed order at the end.
+ *
+ * @param start The first number of the range.
+ * @param end The last number of the range.
+ * @return The compensated sum of the square roots of the numbers from 'start' to 'end'.
+ */
+__attribute__((target("avx2")))
+CompensatedSum preciseSumAvx2(long long int start, long long int end) {
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    __m256d compensation0 = _mm256_setzero_pd(), compensation1 = _mm256_setzero_pd();
+    __m256d value0 = _mm256_add_pd(_mm256_set1_pd((double) start), _mm256_setr_pd(0, 1, 2, 3));
+    __m256d value1 = _mm256_add_pd(value0, _mm256_set1_pd(4.0));
+    __m256d blockStep = _mm256_set1_pd(8.0);
+    long long int i = start;
+
+    for (; end - i >= 7; i += 8) {
+        __m256d root0 = _mm256_sqrt_pd(value0), root1 = _mm256_sqrt_pd(value1);
+        __m256d total0 = _mm256_add_pd(sum0, root0), total1 = _mm256_add_pd(sum1, root1);
+        compensation0 = _mm256_add_pd(compensation0, _mm256_add_pd(_mm256_sub_pd(_mm256_max_pd(sum0, root0), total0),
+                                                                   _mm256_min_pd(sum0, root0)));
+        compensation1 = _mm256_add_pd(compensation1, _mm256_add_pd(_mm256_sub_pd(_mm256_max_pd(sum1, root1), total1),
+                                                                   _mm256_min_pd(sum1, root1)));
+        sum0 = total0;
+        sum1 = total1;
+        value0 = _mm256_add_pd(value0, blockStep);
+        value1 = _mm256_add_pd(value1, blockStep);
+    }
+
+    double sums[8], compensations[8];
+    _mm256_storeu_pd(sums, sum0);
+    _mm256_storeu_pd(sums + 4, sum1);
+    _mm256_storeu_pd(compensations, compensation0);
+    _mm256_storeu_pd(compensations + 4, compensation1);
+    CompensatedSum result = preciseSumScalar(i, end);
+    for (int lane = 0; lane < 8; ++lane) {
+        CompensatedSum laneSum = {sums[lane], compensations[lane]};
+        result = addCompensated(result, laneSum);
+    }
+    return result;
+}
+
+/**
+ * @brief Calculates the compensated sum of square roots for a range of numbers with AVX-512.
+ *
+ * This works like preciseSumAvx2, with vectors of 8 doubles.
+ *
+ * @param start The first number of the range.
+ * @param end The last number of the range.
+ * @return The compensated sum of the square roots of the numbers from 'start' to 'end'.
+ */
+__attribute__((target("avx512f")))
+CompensatedSum preciseSumAvx512(long long int start, long long int end) {
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    __m512d compensation0 = _mm512_setzero_pd(), compensation1 = _mm512_setzero_pd();
+    __m512d value0 = _mm512_add_pd(_mm512_set1_pd((double) start), _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7));
+    __m512d value1 = _mm512_add_pd(value0, _mm512_set1_pd(8.0));
+    __m512d blockStep = _mm512_set1_pd(16.0);
+    long long int i = start;
+
+    for (; end - i >= 15; i += 16) {
+        __m512d root0 = _mm512_sqrt_pd(value0), root1 = _mm512_sqrt_pd(value1);
+        __m512d total0 = _mm512_add_pd(sum0, root0), total1 = _mm512_add_pd(sum1, root1);
+        compensation0 = _mm512_add_pd(compensation0, _mm512_add_pd(_mm512_sub_pd(_mm512_max_pd(sum0, root0), total0),
+                                                                   _mm512_min_pd(sum0, root0)));
+        compensation1 = _mm512_add_pd(compensation1, _mm512_add_pd(_mm512_sub_pd(_mm512_max_pd(sum1, root1), total1),
+                                                                   _mm512_min_pd(sum1, root1)));
+        sum0 = total0;
+        sum1 = total1;
+        value0 = _mm512_add_pd(value0, blockStep);
+        value1 = _mm512_add_pd(value1, blockStep);
+    }
+
+    double sums[16], compensations[16];
+    _mm512_storeu_pd(sums, sum0);
+    _mm512_storeu_pd(sums + 8, sum1);
+    _mm512_storeu_pd(compensations, compensation0);
+    _mm512_storeu_pd(compensations + 8, compensation1);
+    CompensatedSum result = preciseSumScalar(i, end);
+    for (int lane = 0; lane < 16; ++lane) {
+        CompensatedSum laneSum = {sums[lane], compensations[lane]};
+        result = addCompensated(result, laneSum);
+    }
+    return result;
+}
+
+#else
+
+CompensatedSum preciseSumAvx2(long long int start, long long int end) {
+    return preciseSumScalar(start, end);
+}
+
+CompensatedSum preciseSumAvx512(long long int start, long long int end) {
+    return preciseSumScalar(start, end);
+}
+
+#endif
+
+/**
+ * @brief Estimates the sum of square roots between 'a' and 'b' with the Euler-Maclaurin formula.
+ *
+ * The sum is the integral of sqrt(x) from 'a' to 'b', plus the average of the two end points, plus the first two
+ * derivative corrections of the formula. It costs nothing to compute and is far more accurate than the printed digits
+ * for large ranges, so it can be used to check the result. Numbers below 1 are skipped, since their square roots are
+ * 0 or not defined.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @return The estimated sum of square roots between 'a' and 'b'.
+ */
+double estimateSqrtSum(long long int a, long long int b) {
+    if (a < 1)
+        a = 1;
+    if (b < a)
+        return 0;
+    long double x = (long double) a, y = (long double) b;
+    long double integral = 2.0L / 3.0L * (y * sqrtl(y) - x * sqrtl(x));
+    long double endPoints = (sqrtl(x) + sqrtl(y)) / 2.0L;
+    long double firstDerivatives = (1.0L / (2.0L * sqrtl(y)) - 1.0L / (2.0L * sqrtl(x))) / 12.0L;
+    long double thirdDerivatives = (3.0L / (8.0L * y * y * sqrtl(y)) - 3.0L / (8.0L * x * x * sqrtl(x))) / 720.0L;
+    return (double) (integral + endPoints + firstDerivatives - thirdDerivatives);
+}
+
+/**
+ * @brief Calculates the compensated sums of a run of blocks for the precise mode of method 4.
+ *
+ * @param args A void pointer to a struct of type `PreciseParameters` that defines the blocks of the thread.
+ * @return None.
+ *
+ * @see executeMethod4Precise
+ */
+void *method4Precise(void *args) {
+    PreciseParameters *preciseParameters = (PreciseParameters *) args;
+
+    for (long long int block = preciseParameters->firstBlock; block < preciseParameters->endBlock; ++block) {
+        long long int start = preciseParameters->a + block * preciseParameters->blockSize;
+        long long int end = start + preciseParameters->blockSize - 1;
+        if (end > preciseParameters->b)
+            end = preciseParameters->b;
+        preciseParameters->blockSums[block] = preciseSumKernel(start, end);
+    }
+
+    pthread_exit(NULL);
+}
+
+/**
+ * @brief Chooses the block size of the precise and checkpointed modes.
+ *
+ * The size only depends on the length of the range, so the blocks, and the order in which their sums are combined,
+ * are the same for every number of threads and every restart.
+ *
+ * @param length The number of numbers in the range.
+ * @return The number of numbers in a block.
+ */
+long long int preciseBlockSize(long long int length) {
+    long long int blockSize = PRECISE_BLOCK_SIZE;
+    while ((length + blockSize - 1) / blockSize > PRECISE_MAX_BLOCKS)
+        blockSize *= 2;
+    return blockSize;
+}
+
+/**
+ * @brief Calculates the sums of the blocks that are not done yet, for the checkpointed mode of method 4.
+ *
+ * The threads take block numbers from a shared counter. A block sum is written before its done flag, with a release
+ * store, so a checkpoint that sees the flag also sees the sum.
+ *
+ * @param args A void pointer to the `CheckpointState` of the run.
+ * @return None.
+ */
+void *method4Checkpointed(void *args) {
+    CheckpointState *state = (CheckpointState *) args;
+    long long int block;
+
+    while ((block = __atomic_fetch_add(&state->nextBlock, 1, __ATOMIC_RELAXED)) < state->blockCount) {
+        if (state->done[block])
+            continue;   // restored from the checkpoint file
+        long long int start = state->a + block * state->blockSize;
+        long long int end = start + state->blockSize - 1;
+        if (end > state->b)
+            end = state->b;
+        if (preciseMode) {
+            state->blockSums[block] = preciseSumKernel(start, end);
+        } else {
+            state->blockSums[block].sum = sqrtSumKernel(start, end);
+            state->blockSums[block].compensation = 0;
+        }
+        __atomic_store_n(&state->done[block], 1, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&state->finishedWorkers, 1, __ATOMIC_RELEASE);
+
+    pthread_exit(NULL);
+}
+
+/**
+ * @brief Reads the checkpoint file of a run, if there is one.
+ *
+ * The file must have been written by a run with the same range, the same mode (precise or not) and the same kernel,
+ * since the kernels may round differently and a resumed run must print the same result as an uninterrupted one.
+ *
+ * @param state The state of the run. The done flags and the sums of the blocks stored in the file are restored.
+ * @return The number of blocks restored, or -1 if the file belongs to a different run or cannot be read.
+ */
+long long int loadCheckpoint(CheckpointState *state) {
+    FILE *file = fopen(state->path, "rb");
+    if (file == NULL)
+        return 0;
+
+    CheckpointHeader header;
+    long long int restored = -1;
+    if (fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) &&
+        header.a == state->a && header.b == state->b && header.blockSize == state->blockSize &&
+        header.blockCount == state->blockCount && header.precise == preciseMode &&
+        !strncmp(header.kernel, sqrtSumKernelName, sizeof(header.kernel)) &&
+        fread(state->done, 1, state->blockCount, file) == (size_t) state->blockCount &&
+        fread(state->blockSums, sizeof(CompensatedSum), state->blockCount, file) == (size_t) state->blockCount) {
+        restored = 0;
+        for (long long int block = 0; block < state->blockCount; ++block) {
+            if (state->done[block])
+                restored++;
+        }
+    }
+    fclose(file);
+    if (restored == -1)
+        memset(state->done, 0, state->blockCount);
+    return restored;
+}
+
+/**
+ * @brief Writes the checkpoint file of a run.
+ *
+ * The done flags are copied first, and a block sum is only stored for a block that was done at that moment, so the
+ * file is consistent while the threads keep working. The file is written next to the checkpoint, synced, and renamed
+ * over it, so a crash at any point leaves either the previous checkpoint or the new one.
+ *
+ * @param state The state of the run.
+ * @return 0 on success, -1 on failure.
+ */
+int writeCheckpoint(CheckpointState *state) {
+    char temporaryPath[4096];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", state->path);
+
+    for (long long int block = 0; block < state->blockCount; ++block) {
+        state->doneSnapshot[block] = __atomic_load_n(&state->done[block], __ATOMIC_ACQUIRE);
+        if (state->doneSnapshot[block])
+            state->sumSnapshot[block] = state->blockSums[block];
+        else
+            memset(&state->sumSnapshot[block], 0, sizeof(CompensatedSum));
+    }
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.a = state->a;
+    header.b = state->b;
+    header.blockSize = state->blockSize;
+    header.blockCount = state->blockCount;
+    header.precise = preciseMode;
+    strncpy(header.kernel, sqrtSumKernelName, sizeof(header.kernel) - 1);
+
+    FILE *file = fopen(temporaryPath, "wb");
+    if (file == NULL) {
+        perror(temporaryPath);
+        return -1;
+    }
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1 ||
+                 fwrite(state->doneSnapshot, 1, state->blockCount, file) != (size_t) state->blockCount ||
+                 fwrite(state->sumSnapshot, sizeof(CompensatedSum), state->blockCount, file) != (size_t) state->blockCount ||
+                 fflush(file) != 0 || fsync(fileno(file)) != 0;
+    if (fclose(file) != 0 || failed || rename(temporaryPath, state->path) != 0) {
+        perror(state->path);
+        unlink(temporaryPath);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Executes method 4 with a checkpoint file, so that a killed run can be resumed.
+ *
+ * The range is cut into the blocks of the precise mode. The blocks already done in the checkpoint file of an earlier
+ * run with the same range, mode and kernel are skipped, and the threads calculate the others. Meanwhile, the main
+ * thread writes the done flags and the block sums to the checkpoint file every 'checkpointInterval' seconds, and once
+ * more at the end. Writing the file only copies a byte and a compensated sum per block, which is far below 1% of the
+ * time it takes to calculate them at the default interval. The block sums are combined with the pairwise reduction of
+ * the precise mode, so a resumed run gives the same result as an uninterrupted one.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads to create.
+ * @return The sum of square roots between 'a' and 'b'.
  */
-void executeMethod1(long long int a, long long int b, int numberOfThreads, long long int rangePerThread) {
+double executeMethod4Checkpointed(long long int a, long long int b, int numberOfThreads) {
+    CheckpointState state;
+    memset(&state, 0, sizeof(state));
+    state.path = checkpointPath;
+    state.a = a;
+    state.b = b;
+    state.blockSize = preciseBlockSize(b - a + 1);
+    state.blockCount = (b - a + state.blockSize) / state.blockSize;
+    state.done = calloc(state.blockCount, 1);
+    state.doneSnapshot = malloc(state.blockCount);
+    state.blockSums = malloc(state.blockCount * sizeof(CompensatedSum));
+    state.sumSnapshot = malloc(state.blockCount * sizeof(CompensatedSum));
+    if (state.done == NULL || state.doneSnapshot == NULL || state.blockSums == NULL || state.sumSnapshot == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    long long int restored = loadCheckpoint(&state);
+    if (restored == -1) {
+        fprintf(stderr, "%s is the checkpoint of a different run\n", checkpointPath);
+        exit(1);
+    }
+    printf("Checkpoint: %s, %lld of %lld blocks restored, written every %.1f s\n", checkpointPath, restored,
+           state.blockCount, checkpointInterval);
+
     pthread_t threads[numberOfThreads];
-    ThreadParameters threadArgs[numberOfThreads];
-    // Calculate the range for each thread
     for (int i = 0; i < numberOfThreads; ++i) {
-        threadArgs[i].start = a + i * rangePerThread;
-        if (i == (numberOfThreads - 1)) {
-            threadArgs[i].end = b;
-        } else {
-            threadArgs[i].end = a + (i + 1) * rangePerThread - 1;
+        createWorkerThread(&threads[i], i, method4Checkpointed, (void *) &state);
+    }
+    double lastCheckpoint = currentSeconds();
+    while (__atomic_load_n(&state.finishedWorkers, __ATOMIC_ACQUIRE) < numberOfThreads) {
+        struct timespec pause = {0, CHECKPOINT_POLL_NANOSECONDS};
+        nanosleep(&pause, NULL);
+        if (currentSeconds() - lastCheckpoint >= checkpointInterval) {
+            writeCheckpoint(&state);
+            lastCheckpoint = currentSeconds();
+        }
+    }
+    for (int i = 0; i < numberOfThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    writeCheckpoint(&state);
+
+    // Pairwise reduction: in round k, block i absorbs block i + 2^k
+    for (long long int width = 1; width < state.blockCount; width *= 2) {
+        for (long long int i = 0; i + width < state.blockCount; i += 2 * width) {
+            state.blockSums[i] = addCompensated(state.blockSums[i], state.blockSums[i + width]);
+        }
+    }
+    double sum = state.blockSums[0].sum + state.blockSums[0].compensation;
+    free(state.done);
+    free(state.doneSnapshot);
+    free(state.blockSums);
+    free(state.sumSnapshot);
+    return sum;
+}
+
+/**
+ * @brief Executes method 4 in precise mode.
+ *
+ * The range is cut into blocks whose size depends only on the length of the range, and every block is summed with
+ * compensated summation. The threads get runs of whole blocks, and after pthread_join the block sums are added
+ * pairwise in a fixed tree. Neither the blocks nor the order of the additions depend on the number of threads,
+ * so the result is the same bit for bit with any number of threads (for the same kernel), and the pairwise
+ * reduction keeps the error of combining the blocks small.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads to create.
+ * @return The sum of square roots between 'a' and 'b'.
+ */
+double executeMethod4Precise(long long int a, long long int b, int numberOfThreads) {
+    long long int length = b - a + 1;
+    long long int blockSize = preciseBlockSize(length);
+    long long int blockCount = (length + blockSize - 1) / blockSize;
+    CompensatedSum *blockSums = malloc(blockCount * sizeof(CompensatedSum));
+    if (blockSums == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    pthread_t threads[numberOfThreads];
+    PreciseParameters threadArgs[numberOfThreads];
+    for (int i = 0; i < numberOfThreads; ++i) {
+        threadArgs[i].a = a;
+        threadArgs[i].b = b;
+        threadArgs[i].blockSize = blockSize;
+        threadArgs[i].blockSums = blockSums;
+        threadArgs[i].firstBlock = blockCount * i / numberOfThreads;
+        threadArgs[i].endBlock = blockCount * (i + 1) / numberOfThreads;
+        createWorkerThread(&threads[i], i, method4Precise, (void *) &threadArgs[i]);
+    }
+    for (int i = 0; i < numberOfThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Pairwise reduction: in round k, block i absorbs block i + 2^k
+    for (long long int width = 1; width < blockCount; width *= 2) {
+        for (long long int i = 0; i + width < blockCount; i += 2 * width) {
+            blockSums[i] = addCompensated(blockSums[i], blockSums[i + width]);
         }
-        pthread_create(&threads[i], NULL, method1, (void *) &threadArgs[i]);
+    }
+    double sum = blockCount > 0 ? blockSums[0].sum + blockSums[0].compensation : 0;
+    free(blockSums);
+    return sum;
+}
+
+/**
+ * @brief Adds two doubles, the combiner of the sum of square roots.
+ */
+static inline double addDoubles(double x, double y) {
+    return x + y;
+}
+
+/* sqrtSumReduce(a, b, numberOfThreads): the lock-free reduction of method 4, running the selected kernel on every part */
+RANGE_REDUCE_DEFINE(sqrtSumReduce, double, 0.0, sqrtSumKernel, addDoubles)
+
+/**
+ * @brief Executes method 4 with multiple threads.
+ *
+ * Method 4 is the generic range reduction of range_reduce.h with the selected square root kernel and addition: the
+ * range is divided like in executeMethod3, every thread writes its partial sum once into a cache-line-aligned slot of
+ * its own, with no lock or atomic, and the main thread adds up the slots in thread order after pthread_join.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads to create.
+ * @return The sum of square roots between 'a' and 'b'.
+ * @see RANGE_REDUCE_DEFINE
+ */
+double executeMethod4(long long int a, long long int b, int numberOfThreads) {
+    return sqrtSumReduce(a, b, numberOfThreads);
+}
+
+/**
+ * @brief Runs one of the first three methods on every part of the range and waits for the threads.
+ *
+ * The range is divided into 'numberOfThreads' parts with rangeReduceSlice, and a thread is created for every part.
+ *
+ * @param method The function of the threads, which receives a `ThreadParameters`.
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads to create.
+ */
+void runMethodThreads(void *(*method)(void *), long long int a, long long int b, int numberOfThreads) {
+    pthread_t threads[numberOfThreads];
+    ThreadParameters threadArgs[numberOfThreads];
+
+    for (int i = 0; i < numberOfThreads; ++i) {
+        rangeReduceSlice(a, b, numberOfThreads, i, &threadArgs[i].start, &threadArgs[i].end);
+        createWorkerThread(&threads[i], i, method, (void *) &threadArgs[i]);
     }
     // Wait for all threads to finish
     for (int i = 0; i < numberOfThreads; ++i) {
         pthread_join(threads[i], NULL);
     }
+}
+
 
-    printf("Method 1: \n");
-    printf("The sum of square roots between %lld and %lld is: %.5e\n", a, b, global_sqrt_sum);
+/**
+ * @brief Executes method 3 with multiple threads.
+ *
+ * This function divides the range between 'a' and 'b' into 'numberOfThreads'
+ * parts and creates a thread for each part to calculate the sum of square roots.
+ * Each thread receives a 'start' and 'end' value specifying the range of values to
+ * calculate the sum of square roots. The main thread waits for all threads to finish
+ * before returning the final result.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads to create.
+ * @return The sum of square roots between 'a' and 'b'.
+ */
+double executeMethod3(long long int a, long long int b, int numberOfThreads) {
+    global_sqrt_sum = 0;
+    runMethodThreads(method3, a, b, numberOfThreads);
+    return global_sqrt_sum;
+}
+
+/**
+  * @brief Executes method 2 with parallel threads.
+  *
+  * This function executes method 2 with parallel threads. It divides the range from 'a' to 'b' into
+  * 'numberOfThreads' sub-ranges, and assigns each sub-range to a separate thread. Each thread
+  * calculates the sum of square roots within its assigned sub-range. The final result is the sum of
+  * square roots from all threads.
+  *
+  * @param a                 The starting value of the range.
+  * @param b                 The ending value of the range.
+  * @param numberOfThreads   The number of threads to be used for parallel execution.
+  * @return The sum of square roots between 'a' and 'b'.
+  * @see method2
+  */
+double executeMethod2(long long int a, long long int b, int numberOfThreads) {
+    global_sqrt_sum = 0;
+    runMethodThreads(method2, a, b, numberOfThreads);
+    return global_sqrt_sum;
+}
+
+
+/**
+ * @brief Executes method1 using multiple threads.
+ *
+ * This function splits the range [a, b] into smaller ranges and assigns each range to a separate thread. The number
+ * of threads is determined by the parameter numberOfThreads. Each thread calculates the sum of square roots within
+ * its assigned range and updates the global_sqrt_sum variable. After all threads have finished, the function returns
+ * the final result.
+ *
+ * @param a             The starting value of the range.
+ * @param b             The ending value of the range.
+ * @param numberOfThreads   The number of threads to use for calculation.
+ * @return The sum of square roots between 'a' and 'b'.
+ */
+double executeMethod1(long long int a, long long int b, int numberOfThreads) {
+    global_sqrt_sum = 0;
+    runMethodThreads(method1, a, b, numberOfThreads);
+    return global_sqrt_sum;
+}
+
+
+/**
+ * @brief Executes the given method and returns its result.
+ *
+ * @param methodNumber The method to execute, from 1 to METHOD_COUNT.
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param numberOfThreads The number of threads to use.
+ * @return The sum of square roots between 'a' and 'b'.
+ */
+double executeMethod(int methodNumber, long long int a, long long int b, int numberOfThreads) {
+    switch (methodNumber) {
+        case 1:
+            return executeMethod1(a, b, numberOfThreads);
+        case 2:
+            return executeMethod2(a, b, numberOfThreads);
+        case 3:
+            return executeMethod3(a, b, numberOfThreads);
+        case 4:
+            if (checkpointPath != NULL)
+                return executeMethod4Checkpointed(a, b, numberOfThreads);
+            if (preciseMode)
+                return executeMethod4Precise(a, b, numberOfThreads);
+            return executeMethod4(a, b, numberOfThreads);
+        default:
+            return executeMethod5(a, b, numberOfThreads);
+    }
+}
+
+/**
+ * @brief Parses a comma separated list of method numbers, such as "2,3,5".
+ *
+ * @param list The list.
+ * @param methods methods[n] is set to 1 for every method n of the list, and to 0 for the others.
+ * @return 1 if the list is valid, 0 otherwise.
+ */
+int parseMethodList(const char *list, int methods[METHOD_COUNT + 1]) {
+    memset(methods, 0, (METHOD_COUNT + 1) * sizeof(int));
+    while (*list != '\0') {
+        char *end;
+        long methodNumber = strtol(list, &end, 10);
+        if (end == list || methodNumber < 1 || methodNumber > METHOD_COUNT || (*end != ',' && *end != '\0'))
+            return 0;
+        methods[methodNumber] = 1;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return 1;
+}
+
+/**
+ * @brief Compares two doubles, for qsort.
+ */
+int compareDoubles(const void *first, const void *second) {
+    double x = *(const double *) first, y = *(const double *) second;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints the results of the benchmark as a table, as CSV or as JSON.
+ *
+ * @param options The options of the benchmark, for the format and the header of the JSON output.
+ * @param results The results.
+ * @param resultCount The number of results.
+ */
+void printBenchmarkResults(const BenchmarkOptions *options, const BenchmarkResult *results, int resultCount) {
+    if (options->format == BENCHMARK_JSON) {
+        static const char *placementNames[] = {"none", "compact", "scatter"};
+        printf("{\"kernel\": \"%s\", \"cores\": %ld, \"placement\": \"%s\", \"precise\": %s, \"repetitions\": %d, \"warmups\": %d, \"results\": [",
+               sqrtSumKernelName, sysconf(_SC_NPROCESSORS_ONLN), placementNames[placement], preciseMode ? "true" : "false", options->repetitions,
+               options->warmups);
+        for (int i = 0; i < resultCount; ++i) {
+            const BenchmarkResult *result = &results[i];
+            printf("%s\n  {\"method\": %d, \"threads\": %d, \"elements\": %lld, \"median_seconds\": %.6f, "
+                   "\"min_seconds\": %.6f, \"ns_per_element\": %.4f, \"elements_per_second\": %.6e, "
+                   "\"elements_per_second_per_core\": %.6e, \"speedup\": %.4f, \"efficiency\": %.4f, "
+                   "\"mutex_wait_seconds\": %.6f, \"sum\": %.17g}", i > 0 ? "," : "", result->methodNumber,
+                   result->threads, result->elements, result->medianSeconds, result->minSeconds,
+                   result->nanosecondsPerElement, result->elementsPerSecond, result->elementsPerSecondPerCore,
+                   result->speedup, result->efficiency, result->mutexWaitSeconds, result->sum);
+        }
+        printf("\n]}\n");
+        return;
+    }
+
+    if (options->format == BENCHMARK_CSV) {
+        printf("method,threads,elements,median_seconds,min_seconds,ns_per_element,elements_per_second,"
+               "elements_per_second_per_core,speedup,efficiency,mutex_wait_seconds,sum\n");
+    } else {
+        printf("Kernel: %s, online cores: %ld, repetitions: %d, warm-up runs: %d\n", sqrtSumKernelName,
+               sysconf(_SC_NPROCESSORS_ONLN), options->repetitions, options->warmups);
+        printf("%-7s %-8s %12s %12s %10s %14s %16s %9s %11s %12s %24s\n", "method", "threads", "elements", "seconds",
+               "ns/elem", "elements/s", "elements/s/core", "speedup", "efficiency", "mutex wait", "sum");
+    }
+    for (int i = 0; i < resultCount; ++i) {
+        const BenchmarkResult *result = &results[i];
+        if (options->format == BENCHMARK_CSV) {
+            printf("%d,%d,%lld,%.6f,%.6f,%.4f,%.6e,%.6e,%.4f,%.4f,%.6f,%.17g\n", result->methodNumber,
+                   result->threads, result->elements, result->medianSeconds, result->minSeconds,
+                   result->nanosecondsPerElement, result->elementsPerSecond, result->elementsPerSecondPerCore,
+                   result->speedup, result->efficiency, result->mutexWaitSeconds, result->sum);
+        } else {
+            printf("%-7d %-8d %12lld %12.4f %10.3f %14.4e %16.4e %8.2fx %10.1f%% %12.4f %24.17g\n",
+                   result->methodNumber, result->threads, result->elements, result->medianSeconds,
+                   result->nanosecondsPerElement, result->elementsPerSecond, result->elementsPerSecondPerCore,
+                   result->speedup, 100 * result->efficiency, result->mutexWaitSeconds, result->sum);
+        }
+    }
+}
+
+/**
+ * @brief Gives the number of threads the benchmark measures after 'numberOfThreads'.
+ *
+ * @param options The options of the benchmark.
+ * @param numberOfThreads The number of threads just measured.
+ * @return The next power of two, or 'maxThreads' if that is smaller; the next number with 'allThreads'.
+ */
+int nextBenchmarkThreads(const BenchmarkOptions *options, int numberOfThreads) {
+    if (options->allThreads)
+        return numberOfThreads + 1;
+    if (numberOfThreads < options->maxThreads && numberOfThreads * 2 > options->maxThreads)
+        return options->maxThreads;
+    return numberOfThreads * 2;
+}
+
+/**
+ * @brief Measures how the methods scale with the number of threads and the size of the range.
+ *
+ * For every selected method, every range size from 'minRange' to 'maxRange' (multiplied by 10 at each step) and every
+ * number of threads given by nextBenchmarkThreads up to 'maxThreads', the method is run 'warmups' times without measuring, then 'repetitions'
+ * times. The median wall time of the repetitions gives the throughput, the speedup over the single-threaded run of
+ * the same method and range, and the parallel efficiency (speedup divided by the number of threads). For method 2 the
+ * time the threads spent waiting for the mutex is reported too, as the median over the repetitions. The throughput per
+ * core divides by the number of threads, or by the number of online cores if there are fewer.
+ *
+ * @param options The options of the benchmark.
+ */
+void benchmarkMethods(const BenchmarkOptions *options) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int resultCount = 0, resultCapacity = 64;
+    BenchmarkResult *results = malloc(resultCapacity * sizeof(BenchmarkResult));
+    double *seconds = malloc(options->repetitions * sizeof(double));
+    double *waits = malloc(options->repetitions * sizeof(double));
+    if (results == NULL || seconds == NULL || waits == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int methodNumber = 1; methodNumber <= METHOD_COUNT; ++methodNumber) {
+        if (!options->methods[methodNumber])
+            continue;
+        for (long long int elements = options->minRange; elements <= options->maxRange; elements *= 10) {
+            long long int a = options->a, b = options->a + elements - 1;
+            double singleThreadSeconds = 0;
+            for (int numberOfThreads = 1; numberOfThreads <= options->maxThreads;
+                 numberOfThreads = nextBenchmarkThreads(options, numberOfThreads)) {
+                double sum = 0;
+                for (int run = 0; run < options->warmups; ++run) {
+                    executeMethod(methodNumber, a, b, numberOfThreads);
+                }
+                for (int run = 0; run < options->repetitions; ++run) {
+                    mutexWaitSeconds = 0;
+                    double start = currentSeconds();
+                    sum = executeMethod(methodNumber, a, b, numberOfThreads);
+                    seconds[run] = currentSeconds() - start;
+                    waits[run] = mutexWaitSeconds;
+                }
+                qsort(seconds, options->repetitions, sizeof(double), compareDoubles);
+                qsort(waits, options->repetitions, sizeof(double), compareDoubles);
+
+                if (resultCount == resultCapacity) {
+                    resultCapacity *= 2;
+                    results = realloc(results, resultCapacity * sizeof(BenchmarkResult));
+                    if (results == NULL) {
+                        perror("realloc");
+                        exit(1);
+                    }
+                }
+                BenchmarkResult *result = &results[resultCount++];
+                double median = seconds[options->repetitions / 2];
+                double activeCores = numberOfThreads < cores ? numberOfThreads : (double) cores;
+                if (numberOfThreads == 1)
+                    singleThreadSeconds = median;
+                result->methodNumber = methodNumber;
+                result->threads = numberOfThreads;
+                result->elements = elements;
+                result->medianSeconds = median;
+                result->minSeconds = seconds[0];
+                result->nanosecondsPerElement = median * 1e9 / (double) elements;
+                result->elementsPerSecond = (double) elements / median;
+                result->elementsPerSecondPerCore = result->elementsPerSecond / activeCores;
+                result->speedup = singleThreadSeconds / median;
+                result->efficiency = result->speedup / numberOfThreads;
+                result->mutexWaitSeconds = methodNumber == 2 ? waits[options->repetitions / 2] : 0;
+                result->sum = sum;
+            }
+        }
+    }
+
+    printBenchmarkResults(options, results, resultCount);
+    free(results);
+    free(seconds);
+    free(waits);
+}
+
+/**
+ * @brief Reads the options of the benchmark mode and runs it.
+ *
+ * @param argc The number of arguments of the program.
+ * @param argv The arguments of the program, the first one after the name being "--bench".
+ * @return The exit status of the program.
+ */
+int runBenchmark(int argc, char *argv[]) {
+    static struct option longOptions[] = {
+            {"start",       required_argument, NULL, 'a'},
+            {"min-range",   required_argument, NULL, 'n'},
+            {"max-range",   required_argument, NULL, 'x'},
+            {"threads",     required_argument, NULL, 't'},
+            {"all-threads", no_argument,       NULL, 'T'},
+            {"methods",     required_argument, NULL, 'm'},
+            {"repetitions", required_argument, NULL, 'r'},
+            {"warmup",      required_argument, NULL, 'w'},
+            {"format",      required_argument, NULL, 'f'},
+            {"precise",     no_argument,       NULL, 'p'},
+            {"affinity",    required_argument, NULL, 'A'},
+            {NULL, 0,                          NULL, 0}
+    };
+    BenchmarkOptions options;
+    options.a = 1;
+    options.minRange = 1000000;
+    options.maxRange = 10000000;
+    options.maxThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    options.allThreads = 0;
+    options.repetitions = 3;
+    options.warmups = 1;
+    options.format = BENCHMARK_TABLE;
+    for (int i = 0; i <= METHOD_COUNT; ++i) {
+        options.methods[i] = i > 0;
+    }
+
+    int option, valid = 1;
+    optind = 2;
+    while ((option = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 'a':
+                options.a = atoll(optarg);
+                break;
+            case 'n':
+                options.minRange = (long long int) strtod(optarg, NULL);
+                break;
+            case 'x':
+                options.maxRange = (long long int) strtod(optarg, NULL);
+                break;
+            case 't':
+                options.maxThreads = !strcmp(optarg, "auto") ? physicalCoreCount : atoi(optarg);
+                break;
+            case 'T':
+                options.allThreads = 1;
+                break;
+            case 'm':
+                valid &= parseMethodList(optarg, options.methods);
+                break;
+            case 'r':
+                options.repetitions = atoi(optarg);
+                break;
+            case 'w':
+                options.warmups = atoi(optarg);
+                break;
+            case 'f':
+                if (!strcmp(optarg, "table"))
+                    options.format = BENCHMARK_TABLE;
+                else if (!strcmp(optarg, "csv"))
+                    options.format = BENCHMARK_CSV;
+                else if (!strcmp(optarg, "json"))
+                    options.format = BENCHMARK_JSON;
+                else
+                    valid = 0;
+                break;
+            case 'p':
+                preciseMode = 1;
+                break;
+            case 'A':
+                if (parsePlacement(optarg) == -1)
+                    valid = 0;
+                else
+                    setPlacement(parsePlacement(optarg));
+                break;
+            default:
+                valid = 0;
+        }
+    }
+    if (!valid || optind != argc || options.minRange < 1 || options.maxRange < options.minRange ||
+        options.maxThreads < 1 || options.repetitions < 1 || options.warmups < 0) {
+        printf("Usage: %s --bench [--start a] [--min-range n] [--max-range n] [--threads max|auto] [--all-threads]\n"
+               "       [--methods 1,2,...] [--repetitions n] [--warmup n] [--format table|csv|json] [--precise]\n"
+               "       [--affinity none|compact|scatter]\n", argv[0]);
+        return 1;
+    }
+    // the placement goes to stderr in the CSV and JSON formats, so that stdout stays machine readable
+    printPlacement(options.format == BENCHMARK_TABLE ? stdout : stderr, options.maxThreads);
+    benchmarkMethods(&options);
+    if (threadPool != NULL)
+        destroyThreadPool(threadPool);
+    return 0;
+}
+
+
+/**
+ * @brief Reads or writes a whole message on a socket.
+ *
+ * @param fd The socket.
+ * @param message The message.
+ * @param writing 1 to write the message, 0 to read it.
+ * @return 1 on success, 0 if the other side closed the connection or an error occurred.
+ */
+int transferMessage(int fd, ShardMessage *message, int writing) {
+    char *bytes = (char *) message;
+    size_t done = 0;
+    while (done < sizeof(ShardMessage)) {
+        ssize_t count = writing ? send(fd, bytes + done, sizeof(ShardMessage) - done, MSG_NOSIGNAL)
+                                : recv(fd, bytes + done, sizeof(ShardMessage) - done, 0);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return 0;
+        done += count;
+    }
+    return 1;
+}
+
+/**
+ * @brief Sends a HEARTBEAT message every HEARTBEAT_SECONDS until the shard of the worker is calculated.
+ *
+ * The worker sends nothing else while the heartbeat thread runs, so the two never write to the socket at once.
+ *
+ * @param args The Heartbeat of the worker.
+ * @return NULL.
+ */
+void *sendHeartbeats(void *args) {
+    Heartbeat *heartbeat = (Heartbeat *) args;
+    pthread_mutex_lock(&heartbeat->lock);
+    while (!heartbeat->finished) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += HEARTBEAT_SECONDS;
+        while (!heartbeat->finished) {
+            if (pthread_cond_timedwait(&heartbeat->done, &heartbeat->lock, &until) == ETIMEDOUT)
+                break;
+        }
+        if (heartbeat->finished)
+            break;
+        ShardMessage message;
+        memset(&message, 0, sizeof(message));
+        message.type = MESSAGE_HEARTBEAT;
+        message.shard = heartbeat->shard;
+        if (!transferMessage(heartbeat->fd, &message, 1))
+            break;
+    }
+    pthread_mutex_unlock(&heartbeat->lock);
+    return NULL;
+}
+
+/**
+ * @brief Runs a worker process: connects to the coordinator and calculates the shards it receives.
+ *
+ * Every shard is calculated with method 4 and 'numberOfThreads' threads, and its sum is sent back. Meanwhile a
+ * heartbeat thread tells the coordinator that the worker is alive, so that a long shard is not taken for a stall. The
+ * worker stops when the coordinator tells it to or closes the connection.
+ *
+ * @param socketPath The path of the UNIX socket of the coordinator.
+ * @param numberOfThreads The number of threads used for every shard.
+ * @return The exit status of the program.
+ */
+int runShardWorker(const char *socketPath, int numberOfThreads) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    int fd = -1;
+    // the coordinator may not be listening yet
+    for (int attempt = 0; attempt < 50 && fd == -1; ++attempt) {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+            close(fd);
+            fd = -1;
+            usleep(100000);
+        }
+    }
+    if (fd == -1) {
+        perror(socketPath);
+        return 1;
+    }
+
+    ShardMessage message;
+    memset(&message, 0, sizeof(message));
+    message.type = MESSAGE_HELLO;
+    message.start = getpid();
+    if (!transferMessage(fd, &message, 1)) {
+        close(fd);
+        return 1;
+    }
+    Heartbeat heartbeat;
+    heartbeat.fd = fd;
+    pthread_mutex_init(&heartbeat.lock, NULL);
+    pthread_cond_init(&heartbeat.done, NULL);
+    while (transferMessage(fd, &message, 0) && message.type == MESSAGE_SHARD) {
+        pthread_t thread;
+        heartbeat.shard = message.shard;
+        heartbeat.finished = 0;
+        int beating = pthread_create(&thread, NULL, sendHeartbeats, &heartbeat) == 0;
+        message.sum = executeMethod4(message.start, message.end, numberOfThreads);
+        if (beating) {
+            pthread_mutex_lock(&heartbeat.lock);
+            heartbeat.finished = 1;
+            pthread_cond_signal(&heartbeat.done);
+            pthread_mutex_unlock(&heartbeat.lock);
+            pthread_join(thread, NULL);
+        }
+        message.type = MESSAGE_RESULT;
+        if (!transferMessage(fd, &message, 1))
+            break;
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * @brief Starts a local worker process, which runs this program with "--worker".
+ *
+ * @param socketPath The path of the UNIX socket of the coordinator.
+ * @param numberOfThreads The number of threads of the worker.
+ * @return The process id of the worker, or -1 on failure.
+ */
+pid_t spawnShardWorker(const char *socketPath, int numberOfThreads) {
+    char threads[16];
+    snprintf(threads, sizeof(threads), "%d", numberOfThreads);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/proc/self/exe", "Project3", "--worker", socketPath, threads, (char *) NULL);
+        perror("execl");
+        _exit(127);
+    }
+    if (pid == -1)
+        perror("fork");
+    return pid;
+}
+
+/**
+ * @brief Drops the connection of a worker and puts its shard back in the queue.
+ *
+ * @param coordinator The state of the coordinator.
+ * @param index The index of the connection.
+ * @param reason Why the worker is dropped, for the message printed.
+ */
+void dropShardWorker(Coordinator *coordinator, int index, const char *reason) {
+    WorkerConnection *connection = &coordinator->connections[index];
+    if (connection->shard != -1) {
+        coordinator->shards[connection->shard].state = SHARD_PENDING;
+        fprintf(stderr, "Worker %d (pid %d) %s, shard %d is reassigned\n", index, (int) connection->pid, reason,
+                connection->shard);
+    } else {
+        fprintf(stderr, "Worker %d (pid %d) %s\n", index, (int) connection->pid, reason);
+    }
+    // a stalled local worker would keep its CPUs busy
+    for (int i = 0; i < coordinator->childCount; ++i) {
+        if (coordinator->children[i] == connection->pid && connection->pid > 0)
+            kill(connection->pid, SIGKILL);
+    }
+    close(connection->fd);
+    connection->fd = -1;
+    connection->shard = -1;
+}
+
+/**
+ * @brief Gives the next pending shard to an idle worker.
+ *
+ * @param coordinator The state of the coordinator.
+ * @param index The index of the connection of the worker.
+ */
+void assignShard(Coordinator *coordinator, int index) {
+    WorkerConnection *connection = &coordinator->connections[index];
+    for (int shard = 0; shard < coordinator->shardCount; ++shard) {
+        if (coordinator->shards[shard].state != SHARD_PENDING)
+            continue;
+        ShardMessage message;
+        memset(&message, 0, sizeof(message));
+        message.type = MESSAGE_SHARD;
+        message.shard = shard;
+        message.start = coordinator->shards[shard].start;
+        message.end = coordinator->shards[shard].end;
+        coordinator->shards[shard].state = SHARD_ASSIGNED;
+        connection->shard = shard;
+        connection->heardAt = currentSeconds();
+        if (!transferMessage(connection->fd, &message, 1))
+            dropShardWorker(coordinator, index, "closed its connection");
+        return;
+    }
+}
+
+/**
+ * @brief Runs the coordinator: splits [a, b] into shards and hands them to worker processes.
+ *
+ * The coordinator listens on a UNIX socket, starts 'workerCount' local workers and also accepts the workers started
+ * by hand with "--worker". Every worker gets one shard at a time, once its HELLO is read by the poll loop like any other
+ * message, so a client that connects and never speaks cannot block the coordinator. Every read also has a timeout of
+ * COORDINATOR_RECEIVE_SECONDS, in case a client sends only part of a message. A worker whose connection breaks, that
+ * does not send its HELLO within 'stallSeconds' of connecting, or that sends neither a heartbeat nor its result for
+ * 'stallSeconds' while it has a shard, is dropped and its shard goes back to the queue; a local worker that is lost is
+ * replaced, up to twice the number of local workers in total. The sums of the shards are added up in
+ * shard order, so the result does not depend on which worker calculated which shard.
+ *
+ * @param a The lower bound of the range.
+ * @param b The upper bound of the range.
+ * @param workerCount The number of local workers to start.
+ * @param threadsPerWorker The number of threads of every local worker.
+ * @param shardCount The number of shards.
+ * @param socketPath The path of the UNIX socket.
+ * @param stallSeconds How long a worker may stay silent while it has a shard.
+ * @return The exit status of the program.
+ */
+int runCoordinator(long long int a, long long int b, int workerCount, int threadsPerWorker, int shardCount,
+                   const char *socketPath, double stallSeconds) {
+    Coordinator coordinator;
+    memset(&coordinator, 0, sizeof(coordinator));
+    coordinator.shardCount = shardCount;
+    coordinator.shards = calloc(shardCount, sizeof(Shard));
+    if (coordinator.shards == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    for (int shard = 0; shard < shardCount; ++shard) {
+        rangeReduceSlice(a, b, shardCount, shard, &coordinator.shards[shard].start, &coordinator.shards[shard].end);
+    }
+    for (int i = 0; i < MAX_WORKER_CONNECTIONS; ++i) {
+        coordinator.connections[i].fd = -1;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketPath);
+    if (listenFd == -1 || bind(listenFd, (struct sockaddr *) &address, sizeof(address)) == -1 ||
+        listen(listenFd, MAX_WORKER_CONNECTIONS) == -1) {
+        perror(socketPath);
+        return 1;
+    }
+    printf("Coordinator: %d shards on %s, %d local workers with %d threads\n", shardCount, socketPath, workerCount,
+           threadsPerWorker);
+    fflush(stdout);
+
+    int restartsLeft = 2 * workerCount;
+    for (int i = 0; i < workerCount && i < MAX_WORKER_CONNECTIONS; ++i) {
+        pid_t pid = spawnShardWorker(socketPath, threadsPerWorker);
+        if (pid > 0)
+            coordinator.children[coordinator.childCount++] = pid;
+    }
+
+    int doneCount = 0, failed = 0;
+    while (doneCount < shardCount && !failed) {
+        struct pollfd fds[MAX_WORKER_CONNECTIONS + 1];
+        int indexes[MAX_WORKER_CONNECTIONS + 1];
+        int fdCount = 0;
+        fds[fdCount].fd = listenFd;
+        fds[fdCount++].events = POLLIN;
+        for (int i = 0; i < MAX_WORKER_CONNECTIONS; ++i) {
+            if (coordinator.connections[i].fd == -1)
+                continue;
+            indexes[fdCount] = i;
+            fds[fdCount].fd = coordinator.connections[i].fd;
+            fds[fdCount++].events = POLLIN;
+        }
+        if (poll(fds, fdCount, COORDINATOR_POLL_MILLISECONDS) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            failed = 1;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+            int index = 0;
+            while (index < MAX_WORKER_CONNECTIONS && coordinator.connections[index].fd != -1)
+                index++;
+            struct timeval timeout = {COORDINATOR_RECEIVE_SECONDS, 0};
+            if (fd != -1 && (index == MAX_WORKER_CONNECTIONS ||
+                             setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1)) {
+                close(fd);
+            } else if (fd != -1) {
+                coordinator.connections[index].fd = fd;
+                coordinator.connections[index].pid = 0;
+                coordinator.connections[index].shard = -1;
+                coordinator.connections[index].greeted = 0;
+                coordinator.connections[index].heardAt = currentSeconds();
+            }
+        }
+
+        for (int i = 1; i < fdCount; ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            WorkerConnection *connection = &coordinator.connections[indexes[i]];
+            ShardMessage message;
+            if (!connection->greeted) {
+                if (!transferMessage(connection->fd, &message, 0) || message.type != MESSAGE_HELLO) {
+                    dropShardWorker(&coordinator, indexes[i], "closed its connection");
+                    continue;
+                }
+                connection->pid = (pid_t) message.start;
+                connection->greeted = 1;
+                continue;
+            }
+            if (!transferMessage(connection->fd, &message, 0)) {
+                dropShardWorker(&coordinator, indexes[i], "closed its connection");
+                continue;
+            }
+            if (message.type == MESSAGE_HEARTBEAT && message.shard == connection->shard) {
+                connection->heardAt = currentSeconds();
+                continue;
+            }
+            if (message.type != MESSAGE_RESULT || message.shard != connection->shard) {
+                dropShardWorker(&coordinator, indexes[i], "closed its connection");
+                continue;
+            }
+            Shard *shard = &coordinator.shards[message.shard];
+            shard->sum = message.sum;
+            shard->state = SHARD_DONE;
+            connection->shard = -1;
+            doneCount++;
+        }
+
+        double now = currentSeconds();
+        int liveWorkers = 0;
+        for (int i = 0; i < MAX_WORKER_CONNECTIONS; ++i) {
+            WorkerConnection *connection = &coordinator.connections[i];
+            if (connection->fd == -1)
+                continue;
+            if (!connection->greeted) {
+                if (now - connection->heardAt > stallSeconds)
+                    dropShardWorker(&coordinator, i, "did not say hello");
+                continue;
+            }
+            if (connection->shard != -1 && now - connection->heardAt > stallSeconds)
+                dropShardWorker(&coordinator, i, "stalled");
+            else if (connection->shard == -1)
+                assignShard(&coordinator, i);
+            if (connection->fd != -1)
+                liveWorkers++;
+        }
+
+        // reap the local workers that exited, and replace them while the restarts last
+        pid_t pid;
+        while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+            for (int i = 0; i < coordinator.childCount; ++i) {
+                if (coordinator.children[i] != pid)
+                    continue;
+                coordinator.children[i] = coordinator.children[--coordinator.childCount];
+                if (restartsLeft > 0 && doneCount < shardCount) {
+                    restartsLeft--;
+                    pid_t replacement = spawnShardWorker(socketPath, threadsPerWorker);
+                    if (replacement > 0)
+                        coordinator.children[coordinator.childCount++] = replacement;
+                }
+                break;
+            }
+        }
+        if (workerCount > 0 && coordinator.childCount == 0 && liveWorkers == 0 && doneCount < shardCount) {
+            fprintf(stderr, "All workers are lost, %d of %d shards are done\n", doneCount, shardCount);
+            failed = 1;
+        }
+    }
+
+    // tell the workers to stop, then wait for the local ones
+    for (int i = 0; i < MAX_WORKER_CONNECTIONS; ++i) {
+        if (coordinator.connections[i].fd == -1)
+            continue;
+        ShardMessage message;
+        memset(&message, 0, sizeof(message));
+        message.type = MESSAGE_SHUTDOWN;
+        transferMessage(coordinator.connections[i].fd, &message, 1);
+        close(coordinator.connections[i].fd);
+    }
+    for (int i = 0; i < coordinator.childCount; ++i) {
+        waitpid(coordinator.children[i], NULL, 0);
+    }
+    close(listenFd);
+    unlink(socketPath);
+
+    if (!failed) {
+        double sum = 0;
+        for (int shard = 0; shard < shardCount; ++shard) {
+            sum += coordinator.shards[shard].sum;
+        }
+        printf("The sum of square roots between %lld and %lld is: %.5e\n", a, b, sum);
+    }
+    free(coordinator.shards);
+    return failed;
+}
+
+/**
+ * @brief Reads the arguments of the coordinator mode and runs it.
+ *
+ * @param argc The number of arguments of the program.
+ * @param argv The arguments of the program, the first one after the name being "--coordinator".
+ * @return The exit status of the program.
+ */
+int runCoordinatorMode(int argc, char *argv[]) {
+    char defaultSocket[108];
+    snprintf(defaultSocket, sizeof(defaultSocket), "/tmp/project3-%d.sock", (int) getpid());
+    const char *socketPath = defaultSocket;
+    double stallSeconds = 10;
+    int shardCount = 0, valid = argc >= 6;
+
+    for (int i = 6; i < argc && valid; ++i) {
+        if (!strcmp(argv[i], "--socket") && i + 1 < argc)
+            socketPath = argv[++i];
+        else if (!strcmp(argv[i], "--shards") && i + 1 < argc)
+            shardCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--stall-timeout") && i + 1 < argc)
+            stallSeconds = atof(argv[++i]);
+        else
+            valid = 0;
+    }
+    long long int a = valid ? atoll(argv[2]) : 0, b = valid ? atoll(argv[3]) : 0;
+    int workerCount = valid ? atoi(argv[4]) : 0, threadsPerWorker = valid ? atoi(argv[5]) : 0;
+    if (shardCount == 0)
+        shardCount = 8 * (workerCount > 0 ? workerCount : 1);
+    if (!valid || b < a || workerCount < 0 || workerCount > MAX_WORKER_CONNECTIONS || threadsPerWorker < 1 ||
+        shardCount < 1 || stallSeconds <= HEARTBEAT_SECONDS || strlen(socketPath) >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+        printf("Usage: %s --coordinator <a> <b> <workers> <threadsPerWorker> [--shards n] [--socket path]\n"
+               "       [--stall-timeout seconds]\n"
+               "       %s --worker <socket> <threads>\n", argv[0], argv[0]);
+        return 1;
+    }
+    return runCoordinator(a, b, workerCount, threadsPerWorker, shardCount, socketPath, stallSeconds);
 }
 
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        printf("Usage: %s <a> <b> <c> <d>\n", argv[0]);
+    selectSqrtSumKernel();
+    loadCpuTopology();
+
+    // Project3 --bench [options]
+    if (argc >= 2 && !strcmp(argv[1], "--bench"))
+        return runBenchmark(argc, argv);
+
+    // Project3 --coordinator <a> <b> <workers> <threadsPerWorker> [options]
+    if (argc >= 2 && !strcmp(argv[1], "--coordinator"))
+        return runCoordinatorMode(argc, argv);
+
+    // Project3 --worker <socket> <threads>
+    if (argc == 4 && !strcmp(argv[1], "--worker") && atoi(argv[3]) > 0)
+        return runShardWorker(argv[2], atoi(argv[3]));
+
+    // Project3 <a> <b> <c> <d> [--precise] [--affinity compact|scatter]
+    int valid = argc >= 5, intervalGiven = 0;
+    for (int i = 5; i < argc && valid; ++i) {
+        if (!strcmp(argv[i], "--precise")) {
+            preciseMode = 1;
+        } else if (!strcmp(argv[i], "--affinity") && i + 1 < argc && parsePlacement(argv[i + 1]) != -1) {
+            setPlacement(parsePlacement(argv[++i]));
+        } else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (!strcmp(argv[i], "--checkpoint-interval") && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            checkpointInterval = atof(argv[++i]);
+            intervalGiven = 1;
+        } else {
+            valid = 0;
+        }
+    }
+    if (!valid) {
+        printf("Usage: %s <a> <b> <c> <d> [--precise] [--affinity compact|scatter]\n"
+               "       [--checkpoint FILE [--checkpoint-interval SECONDS]]\n", argv[0]);
         return 1;
     }
     long long int a = atoll(argv[1]);
     long long int b = atoll(argv[2]);
-    int c = atoi(argv[3]);
+    // c is "auto" to run one thread on every physical core
+    int c = !strcmp(argv[3], "auto") ? physicalCoreCount : atoi(argv[3]);
     int d = atoi(argv[4]);
     int methodNumber = d;
     int numberOfThreads = c;
-    long long int rangePerThread = (b - a) / numberOfThreads;
 
-    switch (methodNumber) {
-        case 1:
-            executeMethod1(a, b, numberOfThreads, rangePerThread);
-            break;
-        case 2:
-            executeMethod2(a, b, numberOfThreads, rangePerThread);
-            break;
-        case 3:
-            executeMethod3(a, b, numberOfThreads, rangePerThread);
-            break;
-        default:
-            printf("Invalid method number.\n");
-            return 1;
+    if (numberOfThreads < 1) {
+        printf("Invalid number of threads: %s. It must be at least 1, or auto.\n", argv[3]);
+        return 1;
+    }
+    if (methodNumber < 1 || methodNumber > METHOD_COUNT) {
+        printf("Invalid method number.\n");
+        return 1;
+    }
+    if (preciseMode && methodNumber != 4) {
+        printf("The precise mode is only available for method 4.\n");
+        return 1;
+    }
+    if (checkpointPath != NULL && (methodNumber != 4 || b < a)) {
+        printf("Checkpoints are only available for method 4 and a non-empty range.\n");
+        return 1;
+    }
+    if (intervalGiven && checkpointPath == NULL) {
+        printf("--checkpoint-interval is only used with --checkpoint FILE.\n");
+        return 1;
+    }
+    if (placement != PLACEMENT_NONE || !strcmp(argv[3], "auto"))
+        printPlacement(stdout, numberOfThreads);
+    double sum = executeMethod(methodNumber, a, b, numberOfThreads);
+    printf("Method %d: \n", methodNumber);
+    printf("The sum of square roots between %lld and %lld is: %.5e\n", a, b, sum);
+    if (preciseMode) {
+        double estimate = estimateSqrtSum(a, b);
+        printf("Precise sum: %.17g\n", sum);
+        printf("Closed-form estimate: %.17g (difference: %.3e)\n", estimate, sum - estimate);
+    }
+    if (threadPool != NULL) {
+        printPoolStatistics(threadPool);
+        destroyThreadPool(threadPool);
     }
     return 0;
 }
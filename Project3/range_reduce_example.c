@@ -0,0 +1,76 @@
+/*
+ * A second use of range_reduce.h, apart from method 4 of Project3: the sum of the logarithms of the numbers in [a, b],
+ * and the largest number of steps the Collatz sequence of a number in [a, b] takes to reach 1.
+ *
+ * Build and run:
+ *     gcc -Wall -Wextra -O2 -pthread -o range_reduce_example range_reduce_example.c -lm
+ *     ./range_reduce_example [a b numberOfThreads]
+ *
+ * Every result is compared with a single-threaded calculation, and the exit status is 1 if one differs.
+ */
+#include <math.h>
+#include "range_reduce.h"
+
+/**
+ * @brief Adds two doubles, as the combiner of the sum of logarithms.
+ */
+static inline double addDoubles(double x, double y) {
+    return x + y;
+}
+
+/**
+ * @brief Gives the natural logarithm of a number of the range.
+ */
+static inline double logarithm(long long int number) {
+    return log((double) number);
+}
+
+/**
+ * @brief Gives the larger of two step counts, as the combiner of the longest Collatz sequence.
+ */
+static inline long long int maxSteps(long long int x, long long int y) {
+    return x > y ? x : y;
+}
+
+/**
+ * @brief Counts the steps the Collatz sequence of a number takes to reach 1.
+ */
+static inline long long int collatzSteps(long long int number) {
+    long long int steps = 0;
+    while (number > 1) {
+        number = number % 2 == 0 ? number / 2 : 3 * number + 1;
+        steps++;
+    }
+    return steps;
+}
+
+RANGE_REDUCE_ELEMENTWISE(sumLogs, double, 0.0, logarithm, addDoubles)
+
+RANGE_REDUCE_ELEMENTWISE(longestCollatz, long long int, 0, collatzSteps, maxSteps)
+
+int main(int argc, char *argv[]) {
+    long long int a = 1, b = 1000000;
+    int numberOfThreads = 4;
+    if (argc == 4) {
+        a = atoll(argv[1]);
+        b = atoll(argv[2]);
+        numberOfThreads = atoi(argv[3]);
+    }
+    if ((argc != 1 && argc != 4) || a < 1 || b < a || numberOfThreads < 1) {
+        printf("Usage: %s [a b numberOfThreads], with 1 <= a <= b\n", argv[0]);
+        return 1;
+    }
+
+    double logSum = sumLogs(a, b, numberOfThreads);
+    double expectedLogSum = sumLogsRange(a, b);
+    long long int steps = longestCollatz(a, b, numberOfThreads);
+    long long int expectedSteps = longestCollatzRange(a, b);
+
+    // the parts are added in a different order than the single loop, so the sums may differ in the last digits
+    int logSumMatches = fabs(logSum - expectedLogSum) <= 1e-12 * fabs(expectedLogSum);
+    printf("Sum of logarithms between %lld and %lld: %.12e (single thread: %.12e)%s\n", a, b, logSum, expectedLogSum,
+           logSumMatches ? "" : " MISMATCH");
+    printf("Longest Collatz sequence between %lld and %lld: %lld steps (single thread: %lld)%s\n", a, b, steps,
+           expectedSteps, steps == expectedSteps ? "" : " MISMATCH");
+    return logSumMatches && steps == expectedSteps ? 0 : 1;
+}